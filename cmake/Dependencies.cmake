@@ -13,6 +13,11 @@ list(APPEND Caffe_LINKER_LIBS PUBLIC ${Boost_LIBRARIES})
 find_package(Threads REQUIRED)
 list(APPEND Caffe_LINKER_LIBS PRIVATE ${CMAKE_THREAD_LIBS_INIT})
 
+# ---[ POSIX shared memory (shm_open is in librt on older glibc)
+if(UNIX AND NOT APPLE)
+  list(APPEND Caffe_LINKER_LIBS PRIVATE rt)
+endif()
+
 # ---[ OpenMP
 if(USE_OPENMP)
   # Ideally, this should be provided by the BLAS library IMPORTED target. However,
@@ -25,8 +30,8 @@ if(USE_OPENMP)
   # into their buildsystem again, so we put these options into per-target PUBLIC
   # compile options and link flags, so that they will be exported properly.
   find_package(OpenMP REQUIRED)
-  list(APPEND Caffe_LINKER_LIBS PRIVATE ${OpenMP_CXX_FLAGS})
-  list(APPEND Caffe_COMPILE_OPTIONS PRIVATE ${OpenMP_CXX_FLAGS})
+  list(APPEND Caffe_LINKER_LIBS PUBLIC ${OpenMP_CXX_FLAGS})
+  list(APPEND Caffe_COMPILE_OPTIONS PUBLIC ${OpenMP_CXX_FLAGS})
 endif()
 
 # ---[ Google-glog
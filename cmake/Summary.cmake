@@ -118,6 +118,7 @@ function(caffe_print_configuration_summary)
   caffe_status("  USE_LEVELDB       :   ${USE_LEVELDB}")
   caffe_status("  USE_LMDB          :   ${USE_LMDB}")
   caffe_status("  USE_NCCL          :   ${USE_NCCL}")
+  caffe_status("  USE_OPENMP        :   ${USE_OPENMP}")
   caffe_status("  ALLOW_LMDB_NOLOCK :   ${ALLOW_LMDB_NOLOCK}")
   # This code is taken from https://github.com/sh1r0/caffe-android-lib
   caffe_status("  USE_HDF5          :   ${USE_HDF5}")
@@ -254,6 +254,17 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareData(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to the given SyncedMemory, which must hold
+   *        at least count() elements and may be shared with Blob%s of other
+   *        shapes -- used by Net to let blobs with disjoint lifetimes share
+   *        storage.
+   *
+   * The diff keeps its contents, and is reallocated only when it is smaller
+   * than the SyncedMemory. Reshaping beyond the size of the SyncedMemory
+   * gives the Blob its own storage again.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& data);
   /**
    * @brief Set the diff_ shared_ptr to point to the SyncedMemory holding the
    *        diff_ of Blob other -- useful in Layer%s which simply perform a copy
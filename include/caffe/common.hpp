@@ -69,6 +69,25 @@ private:\
 // is executed we will see a fatal log.
 #define NOT_IMPLEMENTED LOG(FATAL) << "Not Implemented Yet"
 
+// Intra-op parallelism for CPU layers. When Caffe is built with OpenMP
+// (USE_OPENMP), CAFFE_PARALLEL_FOR splits the for loop that follows it across
+// Caffe::num_threads() threads; CAFFE_PARALLEL_FOR_IF only does so when cond
+// holds, so that short loops do not pay for waking the pool. Without OpenMP
+// both expand to nothing and the loop runs serially. Loop iterations must be
+// independent and must not touch per-thread state such as Caffe::rng_stream().
+#ifdef _OPENMP
+#define CAFFE_PARALLEL_FOR _Pragma(AS_STRING( \
+    omp parallel for num_threads(::caffe::Caffe::num_threads())))
+#define CAFFE_PARALLEL_FOR_IF(cond) _Pragma(AS_STRING( \
+    omp parallel for if(cond) num_threads(::caffe::Caffe::num_threads())))
+#else
+#define CAFFE_PARALLEL_FOR
+#define CAFFE_PARALLEL_FOR_IF(cond)
+#endif
+
+// Element-wise loops over fewer elements than this run serially.
+#define CAFFE_PARALLEL_MIN_COUNT 16384
+
 // See PR #1236
 namespace cv { class Mat; }
 
@@ -93,6 +112,10 @@ using std::string;
 using std::stringstream;
 using std::vector;
 
+// A random seed from the system entropy source, or from the pid and time if
+// there is none.
+int64_t cluster_seedgen(void);
+
 // A global initialization function that you should call in your main function.
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
@@ -166,6 +189,12 @@ class Caffe {
   inline static bool multiprocess() { return Get().multiprocess_; }
   inline static void set_multiprocess(bool val) { Get().multiprocess_ = val; }
   inline static bool root_solver() { return Get().solver_rank_ == 0; }
+  // Intra-op parallelism of CPU layers (see CAFFE_PARALLEL_FOR). The thread
+  // count is shared by the whole process rather than kept per thread, so
+  // solver, test and prefetch threads all use the same setting. A value <= 0
+  // restores the OpenMP default (OMP_NUM_THREADS or the number of cores).
+  static int num_threads();
+  static void set_num_threads(const int num_threads);
 
  protected:
 #ifndef CPU_ONLY
@@ -25,6 +25,12 @@ class DataTransformer {
    */
   void InitRand();
 
+  /**
+   * @brief Initialize the Random number generations if needed by the
+   *    transformation, from the given seed.
+   */
+  void InitRand(unsigned int seed);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to the data.
@@ -291,6 +291,18 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Offers the layer a scratch Blob shared by all layers of its Net,
+   *        to use instead of owning its own temporary buffers.
+   *
+   * Called before SetUp. The Net runs one layer at a time, so the contents
+   * of the workspace do not outlive a single Forward or Backward call.
+   * Layers that accept it reshape it to their needs before each use, and
+   * since Blob storage only grows it ends up as large as the largest need.
+   * The default implementation keeps the layer's own buffers.
+   */
+  virtual void SetSharedWorkspace(const shared_ptr<Blob<Dtype> >& workspace) {}
+
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -1,6 +1,8 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <stdint.h>
+
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -18,11 +20,14 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), col_buffer_(new Blob<Dtype>()) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual void SetSharedWorkspace(const shared_ptr<Blob<Dtype> >& workspace) {
+    col_buffer_ = workspace;
+  }
 
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
@@ -40,6 +45,27 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Applies the fused ReLU, if any, in place to count outputs.
+  void forward_cpu_relu(Dtype* output, int count);
+  // Batch versions of forward_cpu_gemm and backward_cpu_gemm over all num_
+  // images, in rounds of num_col_buffers_ images with a column buffer each.
+  // The im2col and col2im of a round run in parallel, its gemms one image at
+  // a time so that the BLAS is never called from the intra-op threads. If bias is non-NULL it is added to each resulting top image,
+  // followed by the fused ReLU when forward_cpu_gemm_batch computes the top.
+  void forward_cpu_gemm_batch(const Dtype* input, const Dtype* weights,
+      Dtype* output, const Dtype* bias = NULL);
+  void backward_cpu_gemm_batch(const Dtype* output, const Dtype* weights,
+      Dtype* input, const Dtype* bias = NULL);
+  // Int8 version of forward_cpu_gemm_batch for quantized inference, see
+  // LayerParameter.quantization_param. The weights are taken from blobs_[0],
+  // and quantized again whenever they have changed.
+  void forward_cpu_int8_batch(const Dtype* input, Dtype* output,
+      const Dtype* bias = NULL);
+  // Version of forward_cpu_gemm_batch reading the weights of blobs_[0] in a
+  // 16-bit type, see LayerParameter.weight_storage. They are converted the
+  // first time this is called and again whenever blobs_[0] has changed.
+  void forward_cpu_half_batch(const Dtype* input, Dtype* output,
+      const Dtype* bias = NULL);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -92,10 +118,35 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief Whether a ReLU is fused into the output, see
+  ///        ConvolutionParameter.fused_relu.
+  bool fused_relu_;
+  Dtype fused_relu_negative_slope_;
+  /// @brief Whether the CPU Forward runs in int8, see
+  ///        LayerParameter.quantization_param.
+  bool int8_;
+  /// @brief The type the CPU Forward reads the weights in, see
+  ///        LayerParameter.weight_storage.
+  StorageType weight_storage_;
 
  private:
+  // forward_cpu_gemm and backward_cpu_gemm on an explicit column buffer.
+  void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
+      Dtype* output, Dtype* col_buff, bool skip_im2col);
+  void backward_cpu_gemm(const Dtype* output, const Dtype* weights,
+      Dtype* input, Dtype* col_buff);
+
+  // The column buffer shaped for this layer. It may be shared with the other
+  // layers of the Net, which reshape it in turn, so always go through here.
+  inline Blob<Dtype>* col_buffer() {
+    col_buffer_->Reshape(col_buffers_shape_);
+    return col_buffer_.get();
+  }
+
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
-  inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
+  // (im2col also lowers the int8 input of forward_cpu_int8_batch)
+  template <typename T>
+  inline void conv_im2col_cpu(const T* data, T* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
       im2col_cpu(data, conv_in_channels_,
           conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
@@ -134,7 +185,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
     } else {
       im2col_nd_gpu(data, num_spatial_axes_, num_kernels_im2col_,
-          conv_input_shape_.gpu_data(), col_buffer_.gpu_shape(),
+          conv_input_shape_.gpu_data(), col_buffer_->gpu_shape(),
           kernel_shape_.gpu_data(), pad_.gpu_data(),
           stride_.gpu_data(), dilation_.gpu_data(), col_buff);
     }
@@ -149,7 +200,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], data);
     } else {
       col2im_nd_gpu(col_buff, num_spatial_axes_, num_kernels_col2im_,
-          conv_input_shape_.gpu_data(), col_buffer_.gpu_shape(),
+          conv_input_shape_.gpu_data(), col_buffer_->gpu_shape(),
           kernel_shape_.gpu_data(), pad_.gpu_data(), stride_.gpu_data(),
           dilation_.gpu_data(), data);
     }
@@ -164,9 +215,27 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int kernel_dim_;
   int col_offset_;
   int output_offset_;
+  int num_col_buffers_;
+  /// @brief The shape of all num_col_buffers_ column buffers together.
+  vector<int> col_buffers_shape_;
 
-  Blob<Dtype> col_buffer_;
+  shared_ptr<Blob<Dtype> > col_buffer_;
   Blob<Dtype> bias_multiplier_;
+
+  // The state of forward_cpu_int8_batch: the weights, quantized per output
+  // channel, the quantized input and the int32 results for each column buffer.
+  vector<int8_t> int8_weight_;
+  vector<Dtype> int8_weight_scale_;
+  // The blobs_[0] data, and its version, that int8_weight_ was quantized from.
+  shared_ptr<SyncedMemory> int8_weight_source_;
+  int int8_weight_version_;
+  vector<int8_t> int8_input_;
+  vector<int32_t> int8_output_;
+  // The weights in the 16-bit type of forward_cpu_half_batch, and the
+  // blobs_[0] data and version they were converted from.
+  vector<uint16_t> half_weight_;
+  shared_ptr<SyncedMemory> half_weight_source_;
+  int half_weight_version_;
 };
 
 }  // namespace caffe
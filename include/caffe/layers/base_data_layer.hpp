@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <boost/function.hpp>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -69,12 +70,38 @@ class BasePrefetchingDataLayer :
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
 
+  // Transforms an item of a batch with the given transformer, into the given
+  // blob shaped like transformed_data_.
+  typedef boost::function<void(int item_id, DataTransformer<Dtype>*,
+      Blob<Dtype>*)> TransformFunction;
+  // Calls transform for each of the count items of a batch, in order on the
+  // prefetch thread, or spread over data_param.decode_threads threads with a
+  // transformer and a blob each. Threads reseed their transformer for each
+  // item, with seeds drawn in item order on the prefetch thread.
+  void TransformItems(int count, const TransformFunction& transform);
+  // Transforms the items of the batch given to worker, every
+  // transformers_.size()-th from item worker on.
+  void TransformWorker(int worker);
+  // Runs on each of the decode threads started by the prefetch thread,
+  // transforming the workers' shares of the batches popped from decode_work_.
+  void DecodeThreadEntry(int device);
+
   vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
   Batch<Dtype>* prefetch_current_;
 
   Blob<Dtype> transformed_data_;
+  // Per decode thread, when there is more than one.
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  vector<shared_ptr<Blob<Dtype> > > transformed_blobs_;
+  // The batch being transformed, handed to the decode threads by pushing
+  // the workers other than 0 to decode_work_, which push them back to
+  // decode_done_ when done.
+  const vector<unsigned int>* decode_seeds_;
+  const TransformFunction* decode_transform_;
+  BlockingQueue<int> decode_work_;
+  BlockingQueue<int> decode_done_;
 };
 
 }  // namespace caffe
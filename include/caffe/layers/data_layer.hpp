@@ -1,6 +1,10 @@
 #ifndef CAFFE_DATA_LAYER_HPP_
 #define CAFFE_DATA_LAYER_HPP_
 
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -28,11 +32,55 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   void Next();
   bool Skip();
+  // Whether the item at offset_ belongs to this solver.
+  bool IsOwnItem() const;
+  void ShuffleKeys();
   virtual void load_batch(Batch<Dtype>* batch);
+  // A serialized Datum, as a view into the db or value_buffers_.
+  typedef std::pair<const char*, int> Value;
+  // Parses and transforms values[item_id] into its slot of the batch. If
+  // cache_fills[item_id] is not -1, the decoded datum is also written to that
+  // slot of the cache.
+  void TransformItem(const vector<Value>& values,
+      const vector<int>& cache_fills, Dtype* top_data, Dtype* top_label,
+      int item_id, DataTransformer<Dtype>* transformer,
+      Blob<Dtype>* transformed_blob);
+  // Sizes the cache of data_param.cache_size_mb after the given datum.
+  void SetUpCache(const Datum& datum);
+  // Looks up the value of the cursor in the cache, returning the slot of the
+  // sample if it is there. Otherwise returns -1, and sets fill_slot to the
+  // slot the decoded value is to be written to, or to -1 if it is not cached.
+  int FindInCache(int* fill_slot);
+  // Decodes an encoded datum as the transformer would.
+  void DecodeForCache(Datum* datum);
 
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
   uint64_t offset_;
+  // Copies of the values of a batch, for cursors without stable_values.
+  vector<string> value_buffers_;
+  // With data_param.shuffle, the keys of this solver in the order they are
+  // read, and the position of the current one.
+  vector<string> keys_;
+  size_t key_position_;
+  shared_ptr<Caffe::RNG> shuffle_rng_;
+  // With data_param.cache_size_mb, decoded samples as serialized Datums, in
+  // slots of cache_slot_size_ bytes of an arena grown up to cache_slots_
+  // slots. A sample is ready once the batch that decoded it is done.
+  struct CachedSample {
+    int slot;
+    bool ready;
+  };
+  std::map<string, CachedSample> cache_;
+  vector<char> cache_arena_;
+  size_t cache_slot_size_;
+  int cache_slots_;
+  // The key and size of the sample in each slot, and the slots from the least
+  // recently used.
+  vector<string> cache_keys_;
+  vector<int> cache_sizes_;
+  std::list<int> cache_lru_;
+  vector<std::list<int>::iterator> cache_uses_;
 };
 
 }  // namespace caffe
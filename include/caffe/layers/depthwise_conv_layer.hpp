@@ -0,0 +1,43 @@
+#ifndef CAFFE_DEPTHWISE_CONV_LAYER_HPP_
+#define CAFFE_DEPTHWISE_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Direct implementation of ConvolutionLayer for 2D depthwise
+ *        convolution (group == input channels) on the CPU.
+ *        Falls back to ConvolutionLayer for other shapes, for the backward
+ *        pass, and in GPU mode.
+ *
+ * With one input channel per group, im2col + GEMM degenerates into a GEMM
+ * with a single output row per group, so most of the time goes to lowering
+ * the input. Instead each output plane is filtered directly from its input
+ * plane, with the planes spread over the intra-op threads.
+ */
+template <typename Dtype>
+class DepthwiseConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DepthwiseConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Whether this instance's shapes admit the direct path.
+  bool use_direct_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DEPTHWISE_CONV_LAYER_HPP_
@@ -7,8 +7,10 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 #include "caffe/layers/base_data_layer.hpp"
 
@@ -17,13 +19,16 @@ namespace caffe {
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
+ * Whole files are loaded at once, or with hdf5_data_param.chunk_size
+ * streamed in chunks of rows read ahead on an internal thread.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
-      : Layer<Dtype>(param), offset_() {}
+      : Layer<Dtype>(param), offset_(), current_chunk_(-1) {}
   virtual ~HDF5DataLayer();
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -48,6 +53,11 @@ class HDF5DataLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
   virtual void LoadHDF5FileData(const char* filename);
+  // Moves on to the next chunk read by the internal thread.
+  void NextChunk();
+  // Reads the chunks of the files in a loop, on the internal thread.
+  virtual void InternalThreadEntry();
+  void ReadChunks(hid_t file_id);
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
@@ -57,6 +67,18 @@ class HDF5DataLayer : public Layer<Dtype> {
   std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
   uint64_t offset_;
+  // When streaming, the top blobs of each chunk, whose slots go to the
+  // internal thread through chunk_free_ and back through chunk_full_. The
+  // current one is in hdf_blobs_.
+  std::vector<std::vector<shared_ptr<Blob<Dtype> > > > chunks_;
+  BlockingQueue<int> chunk_free_;
+  BlockingQueue<int> chunk_full_;
+  int current_chunk_;
+  // With hdf5_data_param.shuffle, the generators of the file and chunk
+  // orders, used by the internal thread when streaming, and of the row
+  // orders, used by Forward.
+  shared_ptr<Caffe::RNG> file_rng_;
+  shared_ptr<Caffe::RNG> row_rng_;
 };
 
 }  // namespace caffe
@@ -7,8 +7,10 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
@@ -18,13 +20,16 @@ namespace caffe {
 /**
  * @brief Write blobs to disk as HDF5 files.
  *
+ * With hdf5_output_param.append, the blobs of every Forward are appended to
+ * the datasets by an internal thread.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5OutputLayer : public Layer<Dtype> {
+class HDF5OutputLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5OutputLayer(const LayerParameter& param)
-      : Layer<Dtype>(param), file_opened_(false) {}
+      : Layer<Dtype>(param), file_opened_(false), datasets_created_(false) {}
   virtual ~HDF5OutputLayer();
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -38,6 +43,8 @@ class HDF5OutputLayer : public Layer<Dtype> {
   virtual inline int ExactNumTopBlobs() const { return 0; }
 
   inline std::string file_name() const { return file_name_; }
+  // Waits for the blobs appended so far to be written.
+  void Flush();
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -49,12 +56,22 @@ class HDF5OutputLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void SaveBlobs();
+  // Appends the blobs of the buffers queued by SaveBlobs, on the internal
+  // thread.
+  virtual void InternalThreadEntry();
 
   bool file_opened_;
   std::string file_name_;
   hid_t file_id_;
   Blob<Dtype> data_blob_;
   Blob<Dtype> label_blob_;
+  // When appending, copies of data_blob_ and label_blob_, whose slots go to
+  // the internal thread through write_full_ and back through write_free_.
+  vector<shared_ptr<Blob<Dtype> > > data_buffers_;
+  vector<shared_ptr<Blob<Dtype> > > label_buffers_;
+  BlockingQueue<int> write_free_;
+  BlockingQueue<int> write_full_;
+  bool datasets_created_;
 };
 
 }  // namespace caffe
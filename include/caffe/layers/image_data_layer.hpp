@@ -11,6 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
 
@@ -33,12 +34,36 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int ExactNumTopBlobs() const { return 2; }
 
  protected:
+  // An image file, read but not decoded yet.
+  struct ImageFile {
+    std::string name;
+    int label;
+    std::string data;
+  };
+
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Reads the file of the current line, and moves on to the next line.
+  void ReadNextFile(ImageFile* file);
+  // Reads files into the slots of files_ given back by load_batch, on the
+  // reader thread.
+  void ReadAheadEntry();
+  // Decodes and transforms the file in slots[item_id] into its slot of the
+  // batch. The first item was decoded by load_batch, as first_img.
+  void DecodeItem(const vector<int>& slots, const cv::Mat& first_img,
+      Dtype* top_data, int item_id, DataTransformer<Dtype>* transformer,
+      Blob<Dtype>* transformed_blob);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // The files of a batch, and with image_data_param.read_ahead those read
+  // ahead of it, whose slots go to the reader through read_free_ and back
+  // through read_full_.
+  vector<ImageFile> files_;
+  BlockingQueue<int> read_free_;
+  BlockingQueue<int> read_full_;
+  shared_ptr<boost::thread> reader_;
 };
 
 
@@ -1,6 +1,8 @@
 #ifndef CAFFE_INNER_PRODUCT_LAYER_HPP_
 #define CAFFE_INNER_PRODUCT_LAYER_HPP_
 
+#include <stdint.h>
+
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -38,6 +40,14 @@ class InnerProductLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Forward_cpu in int8, see LayerParameter.quantization_param.
+  void Forward_cpu_int8(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Forward_cpu with 16-bit weights, see LayerParameter.weight_storage.
+  void Forward_cpu_half(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief The weights as N_ x K_ rows, transposed into weight_rows if needed.
+  const Dtype* output_weights(vector<Dtype>* weight_rows) const;
 
   int M_;
   int K_;
@@ -45,6 +55,24 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  bool int8_;  ///< if true, compute the CPU Forward in int8
+  /// The N_ x K_ int8 weights, quantized per output at the first int8 Forward
+  /// and again whenever blobs_[0] has changed.
+  vector<int8_t> int8_weight_;
+  vector<Dtype> int8_weight_scale_;
+  /// The blobs_[0] data, and its version, that int8_weight_ was quantized from.
+  shared_ptr<SyncedMemory> int8_weight_source_;
+  int int8_weight_version_;
+  vector<int8_t> int8_bottom_;
+  vector<int32_t> int8_top_;
+  StorageType weight_storage_;  ///< the type the CPU Forward reads weights in
+  /// The N_ x K_ 16-bit weights, converted at the first such Forward and
+  /// again whenever blobs_[0] has changed.
+  vector<uint16_t> half_weight_;
+  /// The blobs_[0] data, and its version, that half_weight_ was converted from.
+  shared_ptr<SyncedMemory> half_weight_source_;
+  int half_weight_version_;
+  vector<Dtype> half_top_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,70 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd minimal filtering implementation of ConvolutionLayer for
+ *        2D 3x3 convolution with stride and dilation 1 on the CPU.
+ *        Falls back to ConvolutionLayer for other shapes, for the backward
+ *        pass, and in GPU mode.
+ *
+ * The input is cut into overlapping (m + 2) x (m + 2) tiles that are
+ * transformed (V = B^T d B) together with the filters (U = G g G^T), so that
+ * each m x m output tile only costs (m + 2)^2 multiplications per input and
+ * output channel pair instead of 9 m^2. The multiplications are done as
+ * (m + 2)^2 independent GEMMs of U and V before the output transform
+ * Y = A^T M A. Tiles of F(4x4, 3x3) are used when the output is large enough
+ * for them to pay off, and F(2x2, 3x3) otherwise.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), transformed_tile_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Whether the convolution parameters admit the Winograd engine.
+  static bool IsSupported(const ConvolutionParameter& conv_param);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  void transform_weights();
+  void transform_input(const Dtype* input);
+  void transform_output(Dtype* output);
+
+  /// @brief Whether this instance's shapes admit the Winograd path.
+  bool use_winograd_;
+  /// @brief Output tile size m of F(m x m, 3x3); the input tile is m + 2.
+  int tile_;
+  int tiles_h_;
+  int tiles_w_;
+  /// @brief Transformed filters, group x (m+2)^2 x (K / group) x (C / group).
+  Blob<Dtype> weight_transform_;
+  /// @brief The tile size, and the blobs_[0] data and version, that
+  ///        weight_transform_ was computed for (tile 0 before the first
+  ///        forward).
+  int transformed_tile_;
+  shared_ptr<SyncedMemory> transformed_weight_source_;
+  int transformed_weight_version_;
+  /// @brief Transformed input tiles, group x (m+2)^2 x (C / group) x tiles.
+  Blob<Dtype> input_transform_;
+  /// @brief Products of filters and tiles, group x (m+2)^2 x (K / group) x
+  ///        tiles, before the output transform.
+  Blob<Dtype> output_transform_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
@@ -78,7 +78,8 @@ class Net {
    * @brief Reshape all layers from bottom to top.
    *
    * This is useful to propagate changes to layer sizes without running
-   * a forward pass, e.g. to compute output feature size.
+   * a forward pass, e.g. to compute output feature size. With
+   * optimize_memory, this also redistributes the shared blob storage.
    */
   void Reshape();
 
@@ -102,6 +103,9 @@ class Net {
   /**
    * @brief For an already initialized net, implicitly copies (i.e., using no
    *        additional memory) the pre-trained layers from another Net.
+   *
+   * Convolutions fused by NetParameter.fuse_layers get copies of the weights
+   * instead, into which the folded layers are folded again.
    */
   void ShareTrainedLayersWith(const Net* other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
@@ -177,6 +181,14 @@ class Net {
   inline const vector<Blob<Dtype>*>& learnable_params() const {
     return learnable_params_;
   }
+  /**
+   * @brief With NetParameter.flat_params, the data or the diffs of all
+   *        learnable_params() in order, as one contiguous CPU array of
+   *        flat_params_count() elements; NULL otherwise.
+   */
+  Dtype* mutable_flat_param_data();
+  Dtype* mutable_flat_param_diff();
+  inline size_t flat_params_count() const { return flat_params_count_; }
   /// @brief returns the learnable parameter learning rate multipliers
   inline const vector<float>& params_lr() const { return params_lr_; }
   inline const vector<bool>& has_params_lr() const { return has_params_lr_; }
@@ -266,6 +278,25 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Assigns the intermediate blobs of an inference net to a small set
+   *        of shared buffers, see NetParameter.optimize_memory.
+   *
+   * Blobs that alias each other (e.g., through Split or Reshape) are treated
+   * as one. Each is live from the first to the last layer that touches it,
+   * and is given a free buffer, best fit by size, at the start of that span.
+   * Returns the bytes of memory then required for data.
+   */
+  size_t OptimizeMemory();
+
+  /// @brief Whether the named layer was folded into a convolution by
+  ///        FuseLayers, see NetParameter.fuse_layers.
+  bool IsFoldedLayer(const string& layer_name) const;
+  /// @brief Folds the trained blobs of the folded layers, by layer name,
+  ///        into the convolutions that they followed.
+  void FoldTrainedLayers(
+      const map<string, vector<shared_ptr<Blob<Dtype> > > >& folded_blobs);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -326,8 +357,18 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The contiguous data and diffs of learnable_params_, see flat_params.
+  shared_ptr<SyncedMemory> flat_param_data_;
+  shared_ptr<SyncedMemory> flat_param_diff_;
+  size_t flat_params_count_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// Scratch storage lent to the layers, see Layer::SetSharedWorkspace.
+  shared_ptr<Blob<Dtype> > workspace_;
+  /// Whether blob storage is shared by lifetime, see OptimizeMemory.
+  bool optimize_memory_;
+  /// The layers folded into each fused convolution, by its name.
+  map<string, vector<LayerParameter> > folded_layers_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   // Callbacks
@@ -1,11 +1,12 @@
 #ifndef CAFFE_PARALLEL_HPP_
 #define CAFFE_PARALLEL_HPP_
 
-#ifdef USE_NCCL
-
+#include <boost/function.hpp>
 #include <boost/thread.hpp>
+#include <sys/types.h>
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -16,7 +17,9 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#ifdef USE_NCCL
 #include "caffe/util/nccl.hpp"
+#endif
 
 namespace caffe {
 
@@ -48,6 +51,8 @@ class Params {
 DISABLE_COPY_AND_ASSIGN(Params);
 };
 
+#ifdef USE_NCCL
+
 // Params stored in GPU memory.
 template<typename Dtype>
 class GPUParams : public Params<Dtype> {
@@ -117,7 +122,205 @@ class NCCL : public GPUParams<Dtype>,
   using Params<Dtype>::diff_;
 };
 
+#endif  // USE_NCCL
+
+/**
+ * @brief Groups the gradients of consecutive layers into buckets of at least
+ *        bucket_size values, and reduces each on a communication thread as
+ *        soon as the backward of its layers is done, hiding the reductions
+ *        behind the backward of the layers below.
+ *
+ * An allreduce backend adds it as an after_backward callback of its net and
+ * calls Finish once the gradients are ready. Without overlap, Finish reduces
+ * all the gradients itself. Either way the scheduler keeps the time spent
+ * reducing, and the part of it the solver waited for in Finish.
+ */
+template<typename Dtype>
+class BucketScheduler : public InternalThread,
+                        public Net<Dtype>::Callback {
+ public:
+  // Reduces the range [offset, offset + count) of the gradients of the net,
+  // laid out one after the other as in Params.
+  typedef boost::function<void(size_t, size_t)> ReduceFunction;
+
+  BucketScheduler(const Net<Dtype>& net, bool overlap, size_t bucket_size,
+                  const ReduceFunction& reduce);
+  ~BucketScheduler();
+
+  // Waits for the buckets still being reduced.
+  void Finish();
+
+  inline int bucket_count() const { return bucket_ranges_.size(); }
+  // Counted from the last ResetStats.
+  inline int iterations() const { return iterations_; }
+  inline double reduce_milliseconds() const { return reduce_ms_; }
+  inline double exposed_milliseconds() const { return exposed_ms_; }
+  void ResetStats();
+
+ protected:
+  void run(int layer);  // Net callback
+  void InternalThreadEntry();
+  void Reduce(size_t offset, size_t count);
+
+  const bool overlap_;
+  const size_t size_;
+  ReduceFunction reduce_;
+  // The bucket to reduce once the backward of each layer is done, or -1.
+  vector<int> layer_buckets_;
+  vector<pair<size_t, size_t> > bucket_ranges_;
+  // Buckets to reduce, then -1 once the gradients are ready.
+  BlockingQueue<int> pending_;
+  BlockingQueue<int> done_;
+  int iterations_;
+  double reduce_ms_;
+  double exposed_ms_;
+};
+
+/**
+ * @brief Averages the gradients of the CPU solvers of several processes, so
+ *        that they train as one with a larger batch. Subclasses move the
+ *        params to their buffers and provide the transport.
+ *
+ * With layer_wise_reduce (and iter_size 1), the reductions are scheduled in
+ * buckets by a BucketScheduler to overlap with backward. Rank 0 logs how much
+ * of the reduction time was exposed every display iterations.
+ */
+template<typename Dtype>
+class CPUAllreduce : public Params<Dtype>,
+                     public Solver<Dtype>::Callback {
+ public:
+  explicit CPUAllreduce(shared_ptr<Solver<Dtype> > solver);
+  virtual ~CPUAllreduce();
+
+  /**
+   * Broadcast weights from rank 0 to the other solvers.
+   */
+  virtual void Broadcast() = 0;
+
+  /**
+   * Trains the solver of this process with those of the others. Rank 0
+   * solves, testing and snapshotting, while the others only step.
+   */
+  void Run();
+
+ protected:
+  // Replaces the params of the solver by data_ and diff_, once allocated.
+  void Configure();
+  // Averages the range [offset, offset + count) of diff_ over all ranks.
+  virtual void Allreduce(size_t offset, size_t count) = 0;
+
+  void on_start() {}
+  void on_gradients_ready();
+
+  shared_ptr<Solver<Dtype> > solver_;
+  const int rank_;
+  const int solver_count_;
+  shared_ptr<BucketScheduler<Dtype> > scheduler_;
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+/**
+ * @brief Averages the gradients of the CPU solvers of several processes on
+ *        one machine, Caffe::solver_count() in all, through a POSIX shared
+ *        memory segment.
+ *
+ * The gradients of each rank are kept in its own slot of the segment. A
+ * reduction sums a range of them in two steps separated by lock-free
+ * barriers: each rank first sums its share of the range over all slots
+ * (reduce-scatter), then copies the whole averaged range back (allgather).
+ * Within one machine this moves as little data per rank as a ring allreduce,
+ * without its solver_count() - 1 rounds of synchronization.
+ */
+template<typename Dtype>
+class ShmAllreduce : public CPUAllreduce<Dtype> {
+ public:
+  /**
+   * Every process creates its instance on the segment of the same name,
+   * from new_name, once Caffe::solver_rank() is set.
+   */
+  ShmAllreduce(shared_ptr<Solver<Dtype> > solver, const string& name);
+  ~ShmAllreduce();
+
+  static string new_name();
+  /**
+   * Forks the processes of ranks 1 to Caffe::solver_count() - 1, returning
+   * their pids in rank 0 and nothing in the others. Each child has its rank
+   * set and its random generator reseeded, so that the ranks draw different
+   * numbers unless SolverParameter.random_seed is set, and is stopped when
+   * rank 0 dies. Call it before any threads are started.
+   */
+  static vector<pid_t> fork_solvers();
+
+  void Broadcast();
+
+ protected:
+  void Allreduce(size_t offset, size_t count);
+  // Waits for every rank to reach the same point.
+  void Barrier();
+  inline Dtype* slot(int rank) const {
+    return slots_ + rank * slot_size_;
+  }
+
+  string name_;
+  void* segment_;
+  size_t segment_bytes_;
+  // The barrier generation each rank has reached, a cache line apart.
+  int64_t* arrived_;
+  int64_t generation_;
+  size_t slot_size_;
+  Dtype* slots_;
+  Dtype* result_;
+  using CPUAllreduce<Dtype>::rank_;
+  using CPUAllreduce<Dtype>::solver_count_;
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+/**
+ * @brief Averages the gradients of CPU solvers on several machines, one
+ *        process each, with a ring allreduce over TCP.
+ *
+ * Rank r listens on the r-th of the host:port endpoints it is given, and
+ * connects to the next rank. A reduction passes chunks of the range around
+ * the ring: in solver_count() - 1 steps each rank adds the chunk it receives
+ * to its own (reduce-scatter), then in as many more it passes the reduced
+ * chunks on (allgather). Each rank sends and receives about twice the range,
+ * however many ranks there are.
+ */
+template<typename Dtype>
+class TcpAllreduce : public CPUAllreduce<Dtype> {
+ public:
+  /**
+   * Every process creates its instance with the same endpoints, one for each
+   * of the Caffe::solver_count() ranks, once Caffe::solver_rank() is set.
+   */
+  TcpAllreduce(shared_ptr<Solver<Dtype> > solver,
+               const vector<string>& hosts);
+  ~TcpAllreduce();
+
+  void Broadcast();
+
+ protected:
+  void Allreduce(size_t offset, size_t count);
+  void Connect(const vector<string>& hosts);
+  // Sends to the next rank while receiving from the previous one, so that
+  // ranks sending to each other do not all wait on full socket buffers.
+  void SendRecv(const void* send, size_t send_bytes, void* recv,
+                size_t recv_bytes);
+
+  int send_fd_;  // To the next rank
+  int recv_fd_;  // From the previous rank
+  vector<Dtype> recv_buffer_;
+  using CPUAllreduce<Dtype>::rank_;
+  using CPUAllreduce<Dtype>::solver_count_;
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
 }  // namespace caffe
 
-#endif  // USE_NCCL
 #endif  // header
@@ -5,9 +5,26 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+/**
+ * @brief The gradient of a param element after SGDSolver::Normalize and
+ *        SGDSolver::Regularize, as the fused CPU updates compute it from the
+ *        element's diff g and data w.
+ */
+template <typename Dtype>
+struct RegularizedGradient {
+  Dtype scale;  ///< 1 / iter_size
+  Dtype l2_decay;
+  Dtype l1_decay;
+
+  inline Dtype operator()(Dtype g, Dtype w) const {
+    return scale * g + l2_decay * w + l1_decay * caffe_sign(w);
+  }
+};
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -31,6 +48,19 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Normalize(int param_id);
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  // Normalize, Regularize, ComputeUpdateValue and the update of the param
+  // data in a single pass on CPU (see SolverParameter.fused_update), over
+  // the learnable params from param_id up to end_id, which FusedUpdateEnd
+  // found to share their multipliers and to lie back to back in memory
+  // along with their history. Solvers overriding ComputeUpdateValue
+  // override this too.
+  virtual void ApplyFusedUpdate(int param_id, int end_id, Dtype rate);
+  int FusedUpdateEnd(int param_id);
+  int FusedCount(int param_id, int end_id);
+  RegularizedGradient<Dtype> GetRegularizedGradient(int param_id);
+  // Moves history_ into one contiguous array if the net has flat params
+  // (see NetParameter.flat_params), for ApplyFusedUpdate to span params.
+  void FlattenHistory();
   virtual void ClipGradients();
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
@@ -42,6 +72,7 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  shared_ptr<SyncedMemory> flat_history_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -57,6 +88,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, int end_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -72,6 +104,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, int end_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -92,6 +125,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, int end_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -116,6 +150,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, int end_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -140,6 +175,7 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ApplyFusedUpdate(int param_id, int end_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -3,11 +3,8 @@
 
 #include <cstdlib>
 
-#ifdef USE_MKL
-  #include "mkl.h"
-#endif
-
 #include "caffe/common.hpp"
+#include "caffe/util/host_memory_pool.hpp"
 
 namespace caffe {
 
@@ -16,6 +13,7 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// Otherwise it comes from HostMemoryPool, which caches freed blocks.
 inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
@@ -24,13 +22,8 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
     return;
   }
 #endif
-#ifdef USE_MKL
-  *ptr = mkl_malloc(size ? size:1, 64);
-#else
-  *ptr = malloc(size);
-#endif
+  *ptr = HostMemoryPool::Allocate(size);
   *use_cuda = false;
-  CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
 
 inline void CaffeFreeHost(void* ptr, bool use_cuda) {
@@ -40,11 +33,7 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
     return;
   }
 #endif
-#ifdef USE_MKL
-  mkl_free(ptr);
-#else
-  free(ptr);
-#endif
+  HostMemoryPool::Free(ptr);
 }
 
 
@@ -68,6 +57,9 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() const { return head_; }
   size_t size() const { return size_; }
+  /// @brief Counts the calls that give write access to the data, so that
+  ///        caches derived from it can tell when it may have changed.
+  int version() const { return version_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -82,6 +74,7 @@ class SyncedMemory {
   void* gpu_ptr_;
   size_t size_;
   SyncedHead head_;
+  int version_;
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
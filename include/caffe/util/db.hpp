@@ -16,8 +16,16 @@ class Cursor {
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
   virtual void Next() = 0;
+  // Moves to the given key, which must be in the db.
+  virtual void Seek(const string& key) = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  // A view of the current value, which saves the copy made by value(). It is
+  // valid until the cursor moves, or for the lifetime of the cursor if
+  // stable_values().
+  virtual const char* value_data() = 0;
+  virtual size_t value_size() = 0;
+  virtual bool stable_values() { return false; }
   virtual bool valid() = 0;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
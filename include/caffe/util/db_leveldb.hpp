@@ -21,8 +21,14 @@ class LevelDBCursor : public Cursor {
   ~LevelDBCursor() { delete iter_; }
   virtual void SeekToFirst() { iter_->SeekToFirst(); }
   virtual void Next() { iter_->Next(); }
+  virtual void Seek(const string& key) {
+    iter_->Seek(key);
+    CHECK(iter_->Valid() && iter_->key() == key) << "Key not found: " << key;
+  }
   virtual string key() { return iter_->key().ToString(); }
   virtual string value() { return iter_->value().ToString(); }
+  virtual const char* value_data() { return iter_->value().data(); }
+  virtual size_t value_size() { return iter_->value().size(); }
   virtual bool valid() { return iter_->Valid(); }
 
  private:
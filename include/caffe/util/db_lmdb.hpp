@@ -27,6 +27,12 @@ class LMDBCursor : public Cursor {
   }
   virtual void SeekToFirst() { Seek(MDB_FIRST); }
   virtual void Next() { Seek(MDB_NEXT); }
+  virtual void Seek(const string& key) {
+    mdb_key_.mv_size = key.size();
+    mdb_key_.mv_data = const_cast<char*>(key.data());
+    Seek(MDB_SET_KEY);
+    CHECK(valid_) << "Key not found: " << key;
+  }
   virtual string key() {
     return string(static_cast<const char*>(mdb_key_.mv_data), mdb_key_.mv_size);
   }
@@ -34,6 +40,13 @@ class LMDBCursor : public Cursor {
     return string(static_cast<const char*>(mdb_value_.mv_data),
         mdb_value_.mv_size);
   }
+  virtual const char* value_data() {
+    return static_cast<const char*>(mdb_value_.mv_data);
+  }
+  virtual size_t value_size() { return mdb_value_.mv_size; }
+  // Values point into the memory map, and stay valid while the read-only
+  // transaction of the cursor is open.
+  virtual bool stable_values() { return true; }
   virtual bool valid() { return valid_; }
 
  private:
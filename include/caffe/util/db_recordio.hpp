@@ -0,0 +1,96 @@
+#ifndef CAFFE_UTIL_DB_RECORDIO_HPP
+#define CAFFE_UTIL_DB_RECORDIO_HPP
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+// A db of records appended one after the other to a file, each a key and a
+// value with their lengths in front, and of the offsets of the records in an
+// index file. Both are in the source directory, and are memory mapped for
+// reading. Integers are in the byte order of the machine.
+//
+// Record: uint32 key size, uint32 value size, key, value.
+// Index: uint64 offset of each record, in the order they were put.
+class RecordIOCursor : public Cursor {
+ public:
+  RecordIOCursor(const char* records, size_t records_size,
+      const uint64_t* offsets, size_t count)
+    : records_(records), records_size_(records_size), offsets_(offsets),
+      count_(count), position_(0), key_data_(NULL), key_size_(0),
+      value_data_(NULL), value_size_(0) {
+    SeekToFirst();
+  }
+  virtual void SeekToFirst() { Move(0); }
+  virtual void Next() { Move(position_ + 1); }
+  virtual void Seek(const string& key);
+  virtual string key() { return string(key_data_, key_size_); }
+  virtual string value() { return string(value_data_, value_size_); }
+  virtual const char* value_data() { return value_data_; }
+  virtual size_t value_size() { return value_size_; }
+  // Values point into the memory map of the db.
+  virtual bool stable_values() { return true; }
+  virtual bool valid() { return position_ < count_; }
+
+ private:
+  // Moves to the record at the given position, reading its header.
+  void Move(size_t position);
+
+  const char* records_;
+  size_t records_size_;
+  const uint64_t* offsets_;
+  size_t count_;
+  size_t position_;
+  const char* key_data_;
+  uint32_t key_size_;
+  const char* value_data_;
+  uint32_t value_size_;
+  // Positions of the keys, built on the first Seek.
+  std::map<string, size_t> positions_;
+};
+
+class RecordIOTransaction : public Transaction {
+ public:
+  explicit RecordIOTransaction(const string& source)
+    : source_(source) { }
+  virtual void Put(const string& key, const string& value);
+  // Appends the records put since the last Commit.
+  virtual void Commit();
+
+ private:
+  string source_;
+  string records_;
+  vector<uint64_t> offsets_;
+
+  DISABLE_COPY_AND_ASSIGN(RecordIOTransaction);
+};
+
+class RecordIO : public DB {
+ public:
+  RecordIO() : mode_(READ), records_(NULL), records_size_(0),
+      offsets_(NULL), offsets_size_(0) { }
+  virtual ~RecordIO() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual RecordIOCursor* NewCursor();
+  virtual RecordIOTransaction* NewTransaction();
+
+ private:
+  string source_;
+  Mode mode_;
+  void* records_;
+  size_t records_size_;
+  void* offsets_;
+  size_t offsets_size_;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_RECORDIO_HPP
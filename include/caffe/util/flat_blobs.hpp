@@ -0,0 +1,28 @@
+#ifndef CAFFE_UTIL_FLAT_BLOBS_HPP_
+#define CAFFE_UTIL_FLAT_BLOBS_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+// Move the data of blobs, or their diffs if diff is set, into one contiguous
+// array on CPU in the order of blobs, keeping their values, and point the
+// blobs into it. The returned array has to outlive the blobs, which must not
+// be reshaped to a larger count since that would move them out of it.
+template <typename Dtype>
+shared_ptr<SyncedMemory> FlattenBlobs(const vector<Blob<Dtype>*>& blobs,
+    bool diff);
+
+// Whether the data (or diffs) of blobs lie back to back on CPU from the start
+// of flat, as FlattenBlobs leaves them.
+template <typename Dtype>
+bool BlobsAreFlat(const vector<Blob<Dtype>*>& blobs, bool diff,
+    SyncedMemory* flat);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FLAT_BLOBS_HPP_
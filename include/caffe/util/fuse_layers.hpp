@@ -0,0 +1,31 @@
+#ifndef CAFFE_UTIL_FUSE_LAYERS_HPP_
+#define CAFFE_UTIL_FUSE_LAYERS_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with the BatchNorm, Scale and ReLU layers that directly
+// follow a Convolution, as its only consumers and in that order, folded into
+// it for inference. The ReLU becomes part of the convolution's output. The
+// BatchNorm and Scale layers are returned in folded_layers, in order, by the
+// name of the Convolution whose trained weights they must be folded into with
+// FoldIntoConvolution; the Convolution gets a bias to hold their shifts.
+void FuseLayers(const NetParameter& param, NetParameter* param_fused,
+    map<string, vector<LayerParameter> >* folded_layers);
+
+// Fold the trained blobs of a BatchNorm or Scale layer into the weights and
+// bias of the Convolution that it follows.
+template <typename Dtype>
+void FoldIntoConvolution(const LayerParameter& folded_layer,
+    const vector<shared_ptr<Blob<Dtype> > >& folded_blobs,
+    const vector<shared_ptr<Blob<Dtype> > >& conv_blobs);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FUSE_LAYERS_HPP_
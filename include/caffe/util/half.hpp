@@ -0,0 +1,112 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+#include <cstring>
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Conversions between float and the 16-bit storage types (see StorageType),
+// rounding to nearest even. Values out of the range of IEEE half precision
+// become infinities, and NaNs stay NaNs.
+inline uint16_t float_to_fp16(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  const uint32_t sign = x & 0x80000000u;
+  x ^= sign;
+  uint16_t h;
+  if (x >= (127 + 16) << 23) {
+    // Infinity, NaN or too large: all exponent bits set.
+    h = x > 0x7f800000u ? 0x7e00 : 0x7c00;
+  } else if (x < (127 - 14) << 23) {
+    // Subnormal or zero: let the float addition of a magic number round the
+    // ten mantissa bits into the low bits.
+    const uint32_t magic_bits = (127 - 15 + 23 - 10 + 1) << 23;
+    float magic;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    std::memcpy(&f, &x, sizeof(f));
+    f += magic;
+    std::memcpy(&x, &f, sizeof(x));
+    h = x - magic_bits;
+  } else {
+    const uint32_t mantissa_odd = (x >> 13) & 1;
+    x += 0xfff + mantissa_odd - ((127 - 15) << 23);
+    h = x >> 13;
+  }
+  return h | (sign >> 16);
+}
+
+inline float fp16_to_float(uint16_t h) {
+  const uint32_t shifted_exponent = 0x7c00 << 13;
+  uint32_t x = (h & 0x7fff) << 13;
+  const uint32_t exponent = x & shifted_exponent;
+  x += (127 - 15) << 23;
+  float f;
+  if (exponent == shifted_exponent) {
+    // Infinity or NaN.
+    x += (128 - 16) << 23;
+    std::memcpy(&f, &x, sizeof(f));
+  } else if (exponent == 0) {
+    // Subnormal or zero: renormalize.
+    x += 1 << 23;
+    const uint32_t magic_bits = 113 << 23;
+    float magic;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    std::memcpy(&f, &x, sizeof(f));
+    f -= magic;
+  } else {
+    std::memcpy(&f, &x, sizeof(f));
+  }
+  return (h & 0x8000) ? -f : f;
+}
+
+inline uint16_t float_to_bf16(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  if ((x & 0x7fffffffu) > 0x7f800000u) {
+    // Keep NaNs quiet, which truncation alone may not.
+    return (x >> 16) | 0x40;
+  }
+  x += 0x7fff + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+inline float bf16_to_float(uint16_t h) {
+  const uint32_t x = static_cast<uint32_t>(h) << 16;
+  float f;
+  std::memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+// Converts n values to and from the 16-bit storage type (FLOAT16 or
+// BFLOAT16).
+template <typename Dtype>
+void caffe_cpu_to_half(const int n, const Dtype* x, const StorageType type,
+    uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int n, const uint16_t* x,
+    const StorageType type, Dtype* y);
+
+// C = A * op(B) for a M x K matrix A held in the 16-bit storage type, which is
+// converted to Dtype a cache-sized block of rows at a time so that A is only
+// read from memory in its 16-bit form. op(B) is K x N and C is M x N. Narrow
+// products are split by rows over Caffe::num_threads(), and wider ones are
+// left to the threads of the BLAS gemm.
+template <typename Dtype>
+void caffe_cpu_half_gemm(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const uint16_t* A, const StorageType type,
+    const Dtype* B, Dtype* C);
+
+// Replaces the data of a BlobProto, as written by Blob::ToProto, with
+// half_data of the given 16-bit storage type. Its diff is left as is. Returns
+// false, leaving the proto as is, if a finite value would become infinite or
+// a nonzero one zero in that type.
+bool ConvertBlobProtoData(const StorageType type, BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
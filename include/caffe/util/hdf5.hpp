@@ -11,6 +11,22 @@
 
 namespace caffe {
 
+/**
+ * @brief Holds the process-wide lock on libhdf5, which is not thread-safe,
+ *        while in scope.
+ *
+ * The functions below take it themselves. Code calling libhdf5 directly
+ * holds one for as long as it does, and may call them meanwhile.
+ */
+class HDF5Lock {
+ public:
+  HDF5Lock();
+  ~HDF5Lock();
+
+ private:
+  DISABLE_COPY_AND_ASSIGN(HDF5Lock);
+};
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -21,11 +37,34 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape = false);
 
+// Loads count rows of a dataset from row start, rows being along its first
+// axis, reshaping blob to hold them.
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    hsize_t start, hsize_t count, Blob<Dtype>* blob);
+
+// The number of rows of a dataset, along its first axis.
+hsize_t hdf5_get_num_rows(hid_t file_id, const char* dataset_name_);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
     bool write_diff = false);
 
+// Creates a dataset of no rows that rows of the given shape can be appended
+// to, stored in chunks of chunk_rows rows compressed at the given gzip level,
+// or not at 0.
+template <typename Dtype>
+void hdf5_create_extendible_dataset(
+    hid_t file_id, const string& dataset_name, const vector<int>& row_shape,
+    hsize_t chunk_rows, int compression);
+
+// Appends the rows of blob, along its first axis, to an extendible dataset.
+template <typename Dtype>
+void hdf5_append_nd_dataset(
+    hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob);
+
 int hdf5_load_int(hid_t loc_id, const string& dataset_name);
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i);
 string hdf5_load_string(hid_t loc_id, const string& dataset_name);
@@ -0,0 +1,54 @@
+#ifndef CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+#define CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+
+#include <cstddef>
+
+namespace caffe {
+
+/**
+ * @brief A thread-safe cache of 64-byte aligned host memory blocks, behind
+ *        CaffeMallocHost, so that reshaping Blob%s and re-creating Net%s reuse
+ *        freed memory instead of going back to the system allocator.
+ *
+ * Requests are rounded up to a size class, in steps of a quarter of the
+ * enclosing power of two so that at most 25% is wasted. Freed blocks are
+ * kept on a free list per class as long as the total cached stays within
+ * cache_limit(); set it to 0 to return every block to the system.
+ */
+class HostMemoryPool {
+ public:
+  struct Stats {
+    /// Allocations served from the cache.
+    size_t hits;
+    /// Allocations that went to the system allocator.
+    size_t misses;
+    /// Bytes currently allocated from the pool.
+    size_t in_use;
+    /// The maximum of in_use so far.
+    size_t peak_in_use;
+    /// Bytes held on the free lists.
+    size_t cached;
+  };
+
+  static void* Allocate(size_t size);
+  static void Free(void* ptr);
+  /// @brief Returns all cached blocks to the system allocator.
+  static void ReleaseCached();
+
+  static size_t cache_limit();
+  static void set_cache_limit(size_t bytes);
+  static Stats stats();
+
+  /// @brief The size of the block that serves a request of size bytes.
+  static size_t SizeClass(size_t size);
+
+  static const size_t kAlignment = 64;
+
+ private:
+  // Static only.
+  HostMemoryPool() {}
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
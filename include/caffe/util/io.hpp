@@ -90,6 +90,9 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Reads the whole of a file into contents, reusing its storage.
+bool ReadFileToString(const string& filename, string* contents);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
@@ -141,6 +144,13 @@ cv::Mat ReadImageToCVMat(const string& filename,
 
 cv::Mat ReadImageToCVMat(const string& filename);
 
+// Decodes an encoded image held in memory, like ReadImageToCVMat. If
+// reduced, a JPEG at least twice as large as height x width is decoded at 1/2,
+// 1/4 or 1/8 of its resolution before resizing, which is much faster but not
+// quite the same as resizing it from full resolution.
+cv::Mat DecodeImageToCVMat(const string& buffer, const int height,
+    const int width, const bool is_color, const bool reduced);
+
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
 
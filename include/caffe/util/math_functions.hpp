@@ -145,6 +145,28 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]))
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Returns the largest absolute value of the elements of vector x
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x);
+
+// Int8 quantization for inference: y = round(x / scale), saturated to the
+// symmetric range [-127, 127].
+template <typename Dtype>
+void caffe_cpu_quantize_int8(const int n, const Dtype scale, const Dtype* x,
+    int8_t* y);
+
+// Quantizes each row of the rows x cols matrix x to int8 with its own scale,
+// amax(row) / 127, which is stored in scales.
+template <typename Dtype>
+void caffe_cpu_quantize_rows_int8(const int rows, const int cols,
+    const Dtype* x, int8_t* y, Dtype* scales);
+
+// Int8 gemm for quantized inference: C = A * op(B), accumulated in int32,
+// where A is M x K and op(B) is K x N. Like caffe_cpu_gemm, the data has to be
+// contiguous in memory.
+void caffe_cpu_gemm_int8(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const int8_t* A, const int8_t* B, int32_t* C);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -0,0 +1,17 @@
+#ifndef CAFFE_UTIL_PLAN_IN_PLACE_HPP_
+#define CAFFE_UTIL_PLAN_IN_PLACE_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with every eligible single-bottom, single-top layer
+// rewritten to run in-place, for the phase in param.state(). A layer is
+// eligible if its type can run in-place in that phase and it is the only
+// consumer of its bottom blob; the bottom blob is renamed to the layer's top
+// blob in the layers that produce it, so the names of later blobs are kept.
+void PlanInPlace(const NetParameter& param, NetParameter* param_in_place);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PLAN_IN_PLACE_HPP_
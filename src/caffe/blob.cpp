@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -158,6 +160,24 @@ void Blob<Dtype>::ShareData(const Blob& other) {
   data_ = other.data();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& data) {
+  CHECK(data);
+  CHECK_GE(data->size(), count_ * sizeof(Dtype));
+  capacity_ = data->size() / sizeof(Dtype);
+  data_ = data;
+  // The diff may hold values set up front, such as the loss weights of loss
+  // layer tops, so it is only replaced when it no longer covers capacity_.
+  if (!diff_ || diff_->size() < capacity_ * sizeof(Dtype)) {
+    shared_ptr<SyncedMemory> diff(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    if (diff_ && diff_->head() != SyncedMemory::UNINITIALIZED) {
+      caffe_copy(count_, static_cast<const Dtype*>(diff_->cpu_data()),
+          static_cast<Dtype*>(diff->mutable_cpu_data()));
+    }
+    diff_ = diff;
+  }
+}
+
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
@@ -492,6 +512,28 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
     }
+  } else if (proto.has_int8_data()) {
+    // int8 weights with one scale per slice along the first axis.
+    const string& int8_data = proto.int8_data();
+    CHECK_EQ(count_, int8_data.size());
+    CHECK_GT(proto.int8_scale_size(), 0);
+    CHECK_EQ(count_ % proto.int8_scale_size(), 0);
+    const int slice_count = count_ / proto.int8_scale_size();
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = static_cast<int8_t>(int8_data[i])
+          * proto.int8_scale(i / slice_count);
+    }
+  } else if (proto.has_half_data()) {
+    const string& half_data = proto.half_data();
+    CHECK_EQ(2 * count_, half_data.size());
+    vector<uint16_t> half_vec(count_);
+    for (int i = 0; i < count_; ++i) {
+      half_vec[i] = static_cast<uint8_t>(half_data[2 * i])
+          | static_cast<uint8_t>(half_data[2 * i + 1]) << 8;
+    }
+    if (count_ > 0) {
+      caffe_cpu_from_half(count_, &half_vec[0], proto.half_type(), data_vec);
+    }
   } else {
     CHECK_EQ(count_, proto.data_size());
     for (int i = 0; i < count_; ++i) {
@@ -521,15 +563,16 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
+  // Copy in bulk rather than adding one element at a time.
+  proto->mutable_double_data()->Resize(count_, 0);
   const double* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_double_data(data_vec[i]);
-  }
+  std::copy(data_vec, data_vec + count_,
+      proto->mutable_double_data()->mutable_data());
   if (write_diff) {
+    proto->mutable_double_diff()->Resize(count_, 0);
     const double* diff_vec = cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      proto->add_double_diff(diff_vec[i]);
-    }
+    std::copy(diff_vec, diff_vec + count_,
+        proto->mutable_double_diff()->mutable_data());
   }
 }
 
@@ -541,15 +584,15 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
+  // Copy in bulk rather than adding one element at a time.
+  proto->mutable_data()->Resize(count_, 0);
   const float* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
-  }
+  std::copy(data_vec, data_vec + count_, proto->mutable_data()->mutable_data());
   if (write_diff) {
+    proto->mutable_diff()->Resize(count_, 0);
     const float* diff_vec = cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      proto->add_diff(diff_vec[i]);
-    }
+    std::copy(diff_vec, diff_vec + count_,
+        proto->mutable_diff()->mutable_data());
   }
 }
 
@@ -4,6 +4,10 @@
 #include <cstdio>
 #include <ctime>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "caffe/common.hpp"
 #include "caffe/util/rng.hpp"
 
@@ -19,6 +23,25 @@ Caffe& Caffe::Get() {
   return *(thread_instance_.get());
 }
 
+// Process-wide intra-op thread count; 0 means use the OpenMP default.
+static int num_threads_ = 0;
+
+int Caffe::num_threads() {
+#ifdef _OPENMP
+  return num_threads_ > 0 ? num_threads_ : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+void Caffe::set_num_threads(const int num_threads) {
+#ifndef _OPENMP
+  LOG_IF(WARNING, num_threads > 1) << "Caffe was built without OpenMP; "
+      << "CPU layers will run on a single thread.";
+#endif
+  num_threads_ = num_threads;
+}
+
 // random seeding
 int64_t cluster_seedgen(void) {
   int64_t s, seed, pid;
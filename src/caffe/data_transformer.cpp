@@ -2,6 +2,7 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -38,6 +39,29 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
   }
 }
 
+// Transforms a row of width pixels, src_stride apart in src, into dst as
+// (pixel - mean) * scale, reversing its order if mirror. The mean is either a
+// row of the mean file, or mean_value if mean_row is NULL. The loops have no
+// branches or index arithmetic, for the compiler to vectorize, and mirroring
+// reverses the row afterwards rather than storing it backwards.
+template <typename Dtype, typename Stype>
+static void TransformRow(const Stype* src, const int src_stride,
+    const int width, const Dtype* mean_row, const Dtype mean_value,
+    const Dtype scale, const bool mirror, Dtype* dst) {
+  if (mean_row) {
+    for (int w = 0; w < width; ++w) {
+      dst[w] = (static_cast<Dtype>(src[w * src_stride]) - mean_row[w]) * scale;
+    }
+  } else {
+    for (int w = 0; w < width; ++w) {
+      dst[w] = (static_cast<Dtype>(src[w * src_stride]) - mean_value) * scale;
+    }
+  }
+  if (mirror) {
+    std::reverse(dst, dst + width);
+  }
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Dtype* transformed_data) {
@@ -93,34 +117,21 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
-  Dtype datum_element;
-  int top_index, data_index;
+  const uint8_t* uint8_data = reinterpret_cast<const uint8_t*>(data.data());
+  const float* float_data = datum.float_data().data();
   for (int c = 0; c < datum_channels; ++c) {
+    const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
     for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        } else {
-          datum_element = datum.float_data(data_index);
-        }
-        if (has_mean_file) {
-          transformed_data[top_index] =
-            (datum_element - mean[data_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (datum_element - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = datum_element * scale;
-          }
-        }
+      const int data_index =
+          (c * datum_height + h_off + h) * datum_width + w_off;
+      const Dtype* mean_row = has_mean_file ? mean + data_index : NULL;
+      Dtype* top_row = transformed_data + (c * height + h) * width;
+      if (has_uint8) {
+        TransformRow(uint8_data + data_index, 1, width, mean_row, mean_value,
+            scale, do_mirror, top_row);
+      } else {
+        TransformRow(float_data + data_index, 1, width, mean_row, mean_value,
+            scale, do_mirror, top_row);
       }
     }
   }
@@ -293,33 +304,16 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 
   CHECK(cv_cropped_img.data);
 
+  // The image is interleaved, so each channel of a row is a strided row.
   Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
   for (int h = 0; h < height; ++h) {
     const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
-      }
+    for (int c = 0; c < img_channels; ++c) {
+      const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+      const Dtype* mean_row = has_mean_file ?
+          mean + (c * img_height + h_off + h) * img_width + w_off : NULL;
+      TransformRow(ptr + c, img_channels, width, mean_row, mean_value, scale,
+          do_mirror, transformed_data + (c * height + h) * width);
     }
   }
 }
@@ -531,6 +525,17 @@ void DataTransformer<Dtype>::InitRand() {
   }
 }
 
+template <typename Dtype>
+void DataTransformer<Dtype>::InitRand(unsigned int seed) {
+  const bool needs_rand = param_.mirror() ||
+      (phase_ == TRAIN && param_.crop_size());
+  if (needs_rand) {
+    rng_.reset(new Caffe::RNG(seed));
+  } else {
+    rng_.reset();
+  }
+}
+
 template <typename Dtype>
 int DataTransformer<Dtype>::Rand(int n) {
   CHECK(rng_);
@@ -10,12 +10,14 @@
 #include "caffe/layers/clip_layer.hpp"
 #include "caffe/layers/conv_layer.hpp"
 #include "caffe/layers/deconv_layer.hpp"
+#include "caffe/layers/depthwise_conv_layer.hpp"
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/relu_layer.hpp"
 #include "caffe/layers/sigmoid_layer.hpp"
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/layers/tanh_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
 #ifdef USE_CUDNN
@@ -42,6 +44,9 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
     const LayerParameter& param) {
   ConvolutionParameter conv_param = param.convolution_param();
   ConvolutionParameter_Engine engine = conv_param.engine();
+  // Whether the layer needs the im2col + GEMM CPU Forward of the CAFFE engine.
+  const bool gemm_only = param.has_quantization_param() ||
+      param.weight_storage() != FLOAT32;
 #ifdef USE_CUDNN
   bool use_dilation = false;
   for (int i = 0; i < conv_param.dilation_size(); ++i) {
@@ -51,21 +56,37 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
   }
 #endif
   if (engine == ConvolutionParameter_Engine_DEFAULT) {
+    // On CPU, Winograd and depthwise change the rounding of the results, so
+    // they are only used when asked for with their engine.
     engine = ConvolutionParameter_Engine_CAFFE;
 #ifdef USE_CUDNN
-    if (!use_dilation) {
+    if (!use_dilation && !conv_param.fused_relu() && !gemm_only) {
       engine = ConvolutionParameter_Engine_CUDNN;
     }
 #endif
   }
+  if (gemm_only && engine != ConvolutionParameter_Engine_CAFFE) {
+    LOG(FATAL) << "Only the CAFFE engine supports quantization_param and "
+               << "weight_storage at Layer " << param.name();
+  }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_WINOGRAD) {
+    return shared_ptr<Layer<Dtype> >(
+        new WinogradConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_DEPTHWISE) {
+    return shared_ptr<Layer<Dtype> >(
+        new DepthwiseConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     if (use_dilation) {
       LOG(FATAL) << "CuDNN doesn't support the dilated convolution at Layer "
                  << param.name();
     }
+    if (conv_param.fused_relu()) {
+      LOG(FATAL) << "CuDNN doesn't support fused_relu at Layer "
+                 << param.name();
+    }
     return shared_ptr<Layer<Dtype> >(new CuDNNConvolutionLayer<Dtype>(param));
 #endif
   } else {
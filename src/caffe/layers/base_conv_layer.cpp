@@ -3,6 +3,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -14,6 +15,20 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Configure the kernel size, padding, stride, and inputs.
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   force_nd_im2col_ = conv_param.force_nd_im2col();
+  fused_relu_ = conv_param.fused_relu();
+  fused_relu_negative_slope_ = conv_param.fused_relu_negative_slope();
+  CHECK(!fused_relu_ || !reverse_dimensions())
+      << "fused_relu is only supported by convolution.";
+  int8_ = this->layer_param_.has_quantization_param();
+  CHECK(!int8_ || !reverse_dimensions())
+      << "quantization_param is only supported by convolution.";
+  int8_weight_source_.reset();
+  weight_storage_ = this->layer_param_.weight_storage();
+  CHECK(weight_storage_ == FLOAT32 || !reverse_dimensions())
+      << "weight_storage is only supported by convolution.";
+  CHECK(weight_storage_ == FLOAT32 || !int8_)
+      << "weight_storage does not apply to int8 (quantization_param).";
+  half_weight_source_.reset();
   channel_axis_ = bottom[0]->CanonicalAxisIndex(conv_param.axis());
   const int first_spatial_axis = channel_axis_ + 1;
   const int num_axes = bottom[0]->num_axes();
@@ -229,7 +244,7 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   // The im2col result buffer will only hold one image at a time to avoid
   // overly large memory usage. In the special case of 1x1 convolution
-  // it goes lazily unused to save memory.
+  // it goes unused to save memory.
   col_buffer_shape_.clear();
   col_buffer_shape_.push_back(kernel_dim_ * group_);
   for (int i = 0; i < num_spatial_axes_; ++i) {
@@ -239,7 +254,22 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       col_buffer_shape_.push_back(output_shape_[i]);
     }
   }
-  col_buffer_.Reshape(col_buffer_shape_);
+  // On CPU, col_buffer_ holds one such buffer for each image that is lowered
+  // concurrently by the *_cpu_gemm_batch helpers. It is only sized here so
+  // that a workspace shared through the Net grows to fit this layer, and is
+  // reshaped again by col_buffer() before each use.
+  num_col_buffers_ = 1;
+  if (Caffe::mode() == Caffe::CPU) {
+    const int parallel_images =
+        this->layer_param_.convolution_param().cpu_parallel_images();
+    num_col_buffers_ = std::max(1, std::min(num_,
+        parallel_images > 0 ? parallel_images : Caffe::num_threads()));
+  }
+  col_buffers_shape_ = col_buffer_shape_;
+  col_buffers_shape_[0] *= num_col_buffers_;
+  if (!is_1x1_) {
+    col_buffer();
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -257,21 +287,184 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
-  const Dtype* col_buff = input;
+  forward_cpu_gemm(input, weights, output,
+      is_1x1_ ? NULL : col_buffer()->mutable_cpu_data(), skip_im2col);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
+    const Dtype* weights, Dtype* output, Dtype* col_buff, bool skip_im2col) {
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buff);
     }
-    col_buff = col_buffer_.cpu_data();
+    input = col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
         group_, conv_out_spatial_dim_, kernel_dim_,
-        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
+        (Dtype)1., weights + weight_offset_ * g, input + col_offset_ * g,
         (Dtype)0., output + output_offset_ * g);
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* weights, Dtype* output, const Dtype* bias) {
+  const int input_dim = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  const int output_dim = reverse_dimensions() ? bottom_dim_ : top_dim_;
+  // Fetch the buffers once, outside of the parallel region.
+  Dtype* col_buff = is_1x1_ ? NULL : col_buffer()->mutable_cpu_data();
+  const int col_count = col_buffer_->count() / num_col_buffers_;
+  if (bias) {
+    bias_multiplier_.cpu_data();
+  }
+  // The images of each round are lowered in parallel, then multiplied one at
+  // a time, as the BLAS must not be called from the intra-op threads.
+  for (int first = 0; first < num_; first += num_col_buffers_) {
+    const int images = std::min(num_col_buffers_, num_ - first);
+    if (col_buff) {
+      CAFFE_PARALLEL_FOR_IF(images > 1)
+      for (int b = 0; b < images; ++b) {
+        conv_im2col_cpu(input + (first + b) * input_dim,
+            col_buff + b * col_count);
+      }
+    }
+    for (int b = 0; b < images; ++b) {
+      const int n = first + b;
+      forward_cpu_gemm(input + n * input_dim, weights,
+          output + n * output_dim, col_buff ? col_buff + b * col_count : NULL,
+          true);
+      if (bias) {
+        forward_cpu_bias(output + n * output_dim, bias);
+      }
+      if (!reverse_dimensions()) {
+        forward_cpu_relu(output + n * output_dim, output_dim);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_int8_batch(const Dtype* input,
+    Dtype* output, const Dtype* bias) {
+  // Quantize the weights again whenever they may have been written to, as
+  // by CopyTrainedLayersFrom, or replaced, as by ShareTrainedLayersWith.
+  const shared_ptr<SyncedMemory>& weight = this->blobs_[0]->data();
+  if (int8_weight_source_ != weight ||
+      int8_weight_version_ != weight->version()) {
+    int8_weight_.resize(this->blobs_[0]->count());
+    int8_weight_scale_.resize(conv_out_channels_);
+    caffe_cpu_quantize_rows_int8(conv_out_channels_, kernel_dim_,
+        this->blobs_[0]->cpu_data(), &int8_weight_[0], &int8_weight_scale_[0]);
+    int8_weight_source_ = weight;
+    int8_weight_version_ = weight->version();
+  }
+  // Quantize the whole batch at once, then lower it in int8.
+  const int count = num_ * bottom_dim_;
+  Dtype input_max = this->layer_param_.quantization_param().bottom_max();
+  if (input_max <= 0) {
+    input_max = caffe_cpu_amax(count, input);
+  }
+  const Dtype input_scale = input_max > 0 ? input_max / 127 : Dtype(1);
+  int8_input_.resize(count);
+  caffe_cpu_quantize_int8(count, input_scale, input, &int8_input_[0]);
+  int8_output_.resize(num_col_buffers_ * top_dim_);
+  // The int8 columns take a quarter or less of the column buffers.
+  int8_t* col_buff = is_1x1_ ? NULL :
+      reinterpret_cast<int8_t*>(col_buffer()->mutable_cpu_data());
+  const int col_count = col_buffer_->count() / num_col_buffers_;
+  CAFFE_PARALLEL_FOR_IF(num_col_buffers_ > 1)
+  for (int b = 0; b < num_col_buffers_; ++b) {
+    int32_t* accum = &int8_output_[b * top_dim_];
+    for (int n = b; n < num_; n += num_col_buffers_) {
+      const int8_t* col = &int8_input_[n * bottom_dim_];
+      if (!is_1x1_) {
+        conv_im2col_cpu(col, col_buff + b * col_count);
+        col = col_buff + b * col_count;
+      }
+      for (int g = 0; g < group_; ++g) {
+        caffe_cpu_gemm_int8(CblasNoTrans, conv_out_channels_ / group_,
+            conv_out_spatial_dim_, kernel_dim_,
+            &int8_weight_[weight_offset_ * g], col + col_offset_ * g,
+            accum + output_offset_ * g);
+      }
+      // Scale the int32 results back, and add the bias in the same pass.
+      Dtype* top = output + n * top_dim_;
+      for (int c = 0; c < conv_out_channels_; ++c) {
+        const Dtype scale = input_scale * int8_weight_scale_[c];
+        const Dtype shift = bias ? bias[c] : Dtype(0);
+        for (int i = c * conv_out_spatial_dim_;
+             i < (c + 1) * conv_out_spatial_dim_; ++i) {
+          top[i] = accum[i] * scale + shift;
+        }
+      }
+      forward_cpu_relu(top, top_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_half_batch(const Dtype* input,
+    Dtype* output, const Dtype* bias) {
+  // Convert the weights again whenever they may have changed, see
+  // forward_cpu_int8_batch.
+  const shared_ptr<SyncedMemory>& weight = this->blobs_[0]->data();
+  if (half_weight_source_ != weight ||
+      half_weight_version_ != weight->version()) {
+    half_weight_.resize(this->blobs_[0]->count());
+    caffe_cpu_to_half(this->blobs_[0]->count(), this->blobs_[0]->cpu_data(),
+        weight_storage_, &half_weight_[0]);
+    half_weight_source_ = weight;
+    half_weight_version_ = weight->version();
+  }
+  Dtype* col_buff = is_1x1_ ? NULL : col_buffer()->mutable_cpu_data();
+  const int col_count = col_buffer_->count() / num_col_buffers_;
+  if (bias) {
+    bias_multiplier_.cpu_data();
+  }
+  // Lowered as in forward_cpu_gemm_batch, as caffe_cpu_half_gemm may call
+  // the BLAS.
+  for (int first = 0; first < num_; first += num_col_buffers_) {
+    const int images = std::min(num_col_buffers_, num_ - first);
+    if (col_buff) {
+      CAFFE_PARALLEL_FOR_IF(images > 1)
+      for (int b = 0; b < images; ++b) {
+        conv_im2col_cpu(input + (first + b) * bottom_dim_,
+            col_buff + b * col_count);
+      }
+    }
+    for (int b = 0; b < images; ++b) {
+      const int n = first + b;
+      const Dtype* col = col_buff ? col_buff + b * col_count
+          : input + n * bottom_dim_;
+      Dtype* top = output + n * top_dim_;
+      for (int g = 0; g < group_; ++g) {
+        caffe_cpu_half_gemm(CblasNoTrans, conv_out_channels_ / group_,
+            conv_out_spatial_dim_, kernel_dim_,
+            &half_weight_[weight_offset_ * g], weight_storage_,
+            col + col_offset_ * g, top + output_offset_ * g);
+      }
+      if (bias) {
+        forward_cpu_bias(top, bias);
+      }
+      forward_cpu_relu(top, top_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_relu(Dtype* output,
+    int count) {
+  if (!fused_relu_) {
+    return;
+  }
+  for (int i = 0; i < count; ++i) {
+    output[i] = std::max(output[i], Dtype(0))
+        + fused_relu_negative_slope_ * std::min(output[i], Dtype(0));
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -283,7 +476,53 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  backward_cpu_gemm(output, weights, input,
+      is_1x1_ ? NULL : col_buffer()->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_batch(const Dtype* output,
+    const Dtype* weights, Dtype* input, const Dtype* bias) {
+  const int input_dim = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  const int output_dim = reverse_dimensions() ? bottom_dim_ : top_dim_;
+  Dtype* col_buff = is_1x1_ ? NULL : col_buffer()->mutable_cpu_data();
+  const int col_count = col_buffer_->count() / num_col_buffers_;
+  if (bias) {
+    bias_multiplier_.cpu_data();
+  }
+  // The images of each round are multiplied one at a time, as in
+  // forward_cpu_gemm_batch, then raised back by col2im in parallel.
+  for (int first = 0; first < num_; first += num_col_buffers_) {
+    const int images = std::min(num_col_buffers_, num_ - first);
+    for (int b = 0; b < images; ++b) {
+      const int n = first + b;
+      Dtype* col = col_buff ? col_buff + b * col_count : input + n * input_dim;
+      for (int g = 0; g < group_; ++g) {
+        caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
+            conv_out_spatial_dim_, conv_out_channels_ / group_,
+            (Dtype)1., weights + weight_offset_ * g,
+            output + n * output_dim + output_offset_ * g,
+            (Dtype)0., col + col_offset_ * g);
+      }
+    }
+    if (col_buff) {
+      CAFFE_PARALLEL_FOR_IF(images > 1)
+      for (int b = 0; b < images; ++b) {
+        conv_col2im_cpu(col_buff + b * col_count,
+            input + (first + b) * input_dim);
+      }
+    }
+    if (bias) {
+      for (int b = 0; b < images; ++b) {
+        forward_cpu_bias(input + (first + b) * input_dim, bias);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
+    const Dtype* weights, Dtype* input, Dtype* col_buff) {
   if (is_1x1_) {
     col_buff = input;
   }
@@ -303,8 +542,8 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    conv_im2col_cpu(input, col_buffer()->mutable_cpu_data());
+    col_buff = col_buffer_->cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -329,9 +568,9 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_gemm(const Dtype* input,
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
+      conv_im2col_gpu(input, col_buffer()->mutable_gpu_data());
     }
-    col_buff = col_buffer_.gpu_data();
+    col_buff = col_buffer_->gpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -352,10 +591,7 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_gpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_gpu_data();
-  if (is_1x1_) {
-    col_buff = input;
-  }
+  Dtype* col_buff = is_1x1_ ? input : col_buffer()->mutable_gpu_data();
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
         conv_out_spatial_dim_, conv_out_channels_ / group_,
@@ -372,8 +608,8 @@ void BaseConvolutionLayer<Dtype>::weight_gpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
-    col_buff = col_buffer_.gpu_data();
+    conv_im2col_gpu(input, col_buffer()->mutable_gpu_data());
+    col_buff = col_buffer_->gpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
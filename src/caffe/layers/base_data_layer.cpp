@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <vector>
 
@@ -8,6 +9,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -37,7 +39,8 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
       prefetch_(param.data_param().prefetch()),
-      prefetch_free_(), prefetch_full_(), prefetch_current_() {
+      prefetch_free_(), prefetch_full_(), prefetch_current_(),
+      decode_seeds_(), decode_transform_() {
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new Batch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
@@ -48,6 +51,16 @@ template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
+  const int decode_threads = this->layer_param_.data_param().decode_threads();
+  CHECK_GT(decode_threads, 0) << "decode_threads must be positive.";
+  if (decode_threads > 1) {
+    for (int i = 0; i < decode_threads; ++i) {
+      transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+          new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+      transformed_blobs_.push_back(shared_ptr<Blob<Dtype> >(
+          new Blob<Dtype>()));
+    }
+  }
 
   // Before starting the prefetch thread, we make cpu_data and gpu_data
   // calls so that the prefetch thread does not accidentally make simultaneous
@@ -84,6 +97,19 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   }
 #endif
 
+  // The decode threads live as long as this one, waiting for batches.
+  boost::thread_group decode_threads;
+  if (transformers_.size() > 1) {
+    int device = 0;
+#ifndef CPU_ONLY
+    CUDA_CHECK(cudaGetDevice(&device));
+#endif
+    for (int i = 1; i < transformers_.size(); ++i) {
+      decode_threads.create_thread(boost::bind(
+          &BasePrefetchingDataLayer<Dtype>::DecodeThreadEntry, this, device));
+    }
+  }
+
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
@@ -102,6 +128,8 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
   }
+  decode_threads.interrupt_all();
+  decode_threads.join_all();
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     CUDA_CHECK(cudaStreamDestroy(stream));
@@ -109,6 +137,65 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::TransformItems(int count,
+    const TransformFunction& transform) {
+  if (transformers_.empty()) {
+    for (int item_id = 0; item_id < count; ++item_id) {
+      transform(item_id, this->data_transformer_.get(), &transformed_data_);
+    }
+    return;
+  }
+  vector<unsigned int> seeds(count);
+  for (int item_id = 0; item_id < count; ++item_id) {
+    seeds[item_id] = caffe_rng_rand();
+  }
+  for (int i = 0; i < transformed_blobs_.size(); ++i) {
+    transformed_blobs_[i]->ReshapeLike(transformed_data_);
+  }
+  // The decode threads use the batch, so they are waited for even on
+  // shutdown.
+  boost::this_thread::disable_interruption no_interruption;
+  decode_seeds_ = &seeds;
+  decode_transform_ = &transform;
+  for (int i = 1; i < transformers_.size(); ++i) {
+    decode_work_.push(i);
+  }
+  TransformWorker(0);
+  for (int i = 1; i < transformers_.size(); ++i) {
+    decode_done_.pop();
+  }
+  decode_seeds_ = NULL;
+  decode_transform_ = NULL;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::TransformWorker(int worker) {
+  DataTransformer<Dtype>* transformer = transformers_[worker].get();
+  for (int item_id = worker; item_id < decode_seeds_->size();
+      item_id += transformers_.size()) {
+    transformer->InitRand((*decode_seeds_)[item_id]);
+    (*decode_transform_)(item_id, transformer,
+        transformed_blobs_[worker].get());
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::DecodeThreadEntry(int device) {
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaSetDevice(device));
+#endif
+  try {
+    while (true) {
+      const int worker = decode_work_.pop();
+      TransformWorker(worker);
+      decode_done_.push(worker);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -28,13 +28,13 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
-      }
+    const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+    if (this->int8_) {
+      this->forward_cpu_int8_batch(bottom_data, top_data, bias);
+    } else if (this->weight_storage_ != FLOAT32) {
+      this->forward_cpu_half_batch(bottom_data, top_data, bias);
+    } else {
+      this->forward_cpu_gemm_batch(bottom_data, weight, top_data, bias);
     }
   }
 }
@@ -42,6 +42,7 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!this->fused_relu_) << "Backward is unavailable with fused_relu.";
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
@@ -55,20 +56,18 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
       }
     }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
+    // gradient w.r.t. weight. Note that we will accumulate diffs, so the
+    // images are visited one at a time.
+    if (this->param_propagate_down_[0]) {
       for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
-        }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
-        }
+        this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff);
       }
     }
+    // gradient w.r.t. bottom data, if necessary.
+    if (propagate_down[i]) {
+      this->backward_cpu_gemm_batch(top_diff, weight, bottom_diff);
+    }
   }
 }
 
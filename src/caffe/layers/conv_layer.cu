@@ -4,6 +4,14 @@
 
 namespace caffe {
 
+template <typename Dtype>
+__global__ void ConvReLUForward(const int n, Dtype* data,
+    Dtype negative_slope) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] = data[index] > 0 ? data[index] : data[index] * negative_slope;
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -19,12 +27,21 @@ void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
         this->forward_gpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
+    if (this->fused_relu_) {
+      const int count = top[i]->count();
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      ConvReLUForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+          CAFFE_CUDA_NUM_THREADS>>>(count, top_data,
+          this->fused_relu_negative_slope_);
+      CUDA_POST_KERNEL_CHECK;
+    }
   }
 }
 
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!this->fused_relu_) << "Backward is unavailable with fused_relu.";
   const Dtype* weight = this->blobs_[0]->gpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_gpu_diff();
   for (int i = 0; i < top.size(); ++i) {
@@ -3,18 +3,25 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <climits>
+#include <string>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    offset_() {
+    offset_(), key_position_(), cache_slot_size_(), cache_slots_() {
   db_.reset(db::GetDB(param.data_param().backend()));
   db_->Open(param.data_param().source(), db::READ);
   cursor_.reset(db_->NewCursor());
@@ -54,20 +61,155 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
+  if (this->layer_param_.data_param().shuffle()) {
+    // Index the keys of this solver's share, which are then read in a random
+    // order instead of skipping the others.
+    for (cursor_->SeekToFirst(); cursor_->valid(); cursor_->Next()) {
+      if (IsOwnItem()) {
+        keys_.push_back(cursor_->key());
+      }
+      offset_++;
+    }
+    offset_ = 0;
+    CHECK(!keys_.empty()) << "No keys to read for solver rank "
+        << Caffe::solver_rank();
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Shuffling " << keys_.size() << " keys";
+    const unsigned int shuffle_rng_seed = caffe_rng_rand();
+    shuffle_rng_.reset(new Caffe::RNG(shuffle_rng_seed));
+    ShuffleKeys();
+  }
+  if (this->layer_param_.data_param().cache_size_mb() > 0) {
+    SetUpCache(datum);
+  }
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::SetUpCache(const Datum& first_datum) {
+  if (first_datum.float_data_size() > 0) {
+    LOG_IF(INFO, Caffe::root_solver()) << "Not caching float_data samples";
+    return;
+  }
+  Datum datum(first_datum);
+  DecodeForCache(&datum);
+  // With room for a longer label.
+  cache_slot_size_ = datum.ByteSize() + 16;
+  const size_t cache_size =
+      static_cast<size_t>(this->layer_param_.data_param().cache_size_mb())
+      << 20;
+  cache_slots_ = std::min<size_t>(cache_size / cache_slot_size_, INT_MAX);
+  if (!keys_.empty() && cache_slots_ >= keys_.size()) {
+    // Every key has a slot of its own.
+    cache_slots_ = keys_.size();
+  } else if (cache_slots_ <= this->layer_param_.data_param().batch_size()) {
+    // The least recently used slot must not be one the batch is using.
+    LOG(WARNING) << "Not caching, as " << cache_slots_ << " samples of "
+        << cache_slot_size_ << " bytes are not more than a batch";
+    cache_slots_ = 0;
+    return;
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Caching up to " << cache_slots_
+      << " samples of " << cache_slot_size_ << " bytes";
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::DecodeForCache(Datum* datum) {
+  if (!datum->encoded()) {
+    return;
+  }
+#ifdef USE_OPENCV
+  const TransformationParameter& transform_param =
+      this->layer_param_.transform_param();
+  if (transform_param.force_color() || transform_param.force_gray()) {
+    DecodeDatum(datum, transform_param.force_color());
+  } else {
+    DecodeDatumNative(datum);
+  }
+#else
+  LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+}
+
+template <typename Dtype>
+int DataLayer<Dtype>::FindInCache(int* fill_slot) {
+  *fill_slot = -1;
+  const string key = cursor_->key();
+  typename std::map<string, CachedSample>::iterator it = cache_.find(key);
+  if (it != cache_.end()) {
+    if (!it->second.ready) {
+      // Still to be decoded by this batch.
+      return -1;
+    }
+    const int slot = it->second.slot;
+    cache_lru_.splice(cache_lru_.end(), cache_lru_, cache_uses_[slot]);
+    return slot;
+  }
+  int slot;
+  if (cache_keys_.size() < cache_slots_) {
+    slot = cache_keys_.size();
+    cache_keys_.push_back(key);
+    cache_sizes_.push_back(0);
+    cache_uses_.push_back(cache_lru_.insert(cache_lru_.end(), slot));
+    if (cache_arena_.size() < cache_keys_.size() * cache_slot_size_) {
+      // Grow by doubling, to no more than all of the slots.
+      cache_arena_.resize(std::min(cache_slots_,
+          std::max<int>(2 * cache_arena_.size() / cache_slot_size_, 64))
+          * cache_slot_size_);
+    }
+  } else {
+    slot = cache_lru_.front();
+    if (!cache_keys_[slot].empty()) {
+      cache_.erase(cache_keys_[slot]);
+    }
+    cache_keys_[slot] = key;
+    cache_lru_.splice(cache_lru_.end(), cache_lru_, cache_uses_[slot]);
+  }
+  CachedSample sample = { slot, false };
+  cache_[key] = sample;
+  *fill_slot = slot;
+  return -1;
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::ShuffleKeys() {
+  caffe::rng_t* shuffle_rng =
+      static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+  shuffle(keys_.begin(), keys_.end(), shuffle_rng);
+  key_position_ = 0;
+  cursor_->Seek(keys_[0]);
 }
 
 template <typename Dtype>
 bool DataLayer<Dtype>::Skip() {
+  if (!keys_.empty()) {
+    // Only this solver's keys are indexed.
+    return false;
+  }
+  return !IsOwnItem();
+}
+
+template <typename Dtype>
+bool DataLayer<Dtype>::IsOwnItem() const {
   int size = Caffe::solver_count();
   int rank = Caffe::solver_rank();
-  bool keep = (offset_ % size) == rank ||
-              // In test mode, only rank 0 runs, so avoid skipping
-              this->layer_param_.phase() == TEST;
-  return !keep;
+  return (offset_ % size) == rank ||
+         // In test mode, only rank 0 runs, so avoid skipping
+         this->layer_param_.phase() == TEST;
 }
 
 template<typename Dtype>
 void DataLayer<Dtype>::Next() {
+  if (!keys_.empty()) {
+    if (++key_position_ == keys_.size()) {
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Restarting data prefetching from start.";
+      ShuffleKeys();
+    } else {
+      cursor_->Seek(keys_[key_position_]);
+    }
+    offset_++;
+    return;
+  }
   cursor_->Next();
   if (!cursor_->valid()) {
     LOG_IF(INFO, Caffe::root_solver())
@@ -89,45 +231,121 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(this->transformed_data_.count());
   const int batch_size = this->layer_param_.data_param().batch_size();
 
-  Datum datum;
+  // Read the items in order, leaving their parsing to the transform. Values
+  // are only copied when the cursor's views of them do not outlive a move.
+  timer.Start();
+  vector<Value> values(batch_size);
+  const bool stable_values = cursor_->stable_values();
+  if (!stable_values) {
+    value_buffers_.resize(batch_size);
+  }
+  // The cache slots of the items found in the cache, and of those to be
+  // written to it.
+  vector<int> cached(batch_size, -1);
+  vector<int> cache_fills(batch_size, -1);
+  int cache_hits = 0;
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
     while (Skip()) {
       Next();
     }
-    datum.ParseFromString(cursor_->value());
-    read_time += timer.MicroSeconds();
-
-    if (item_id == 0) {
-      // Reshape according to the first datum of each batch
-      // on single input batches allows for inputs of varying dimension.
-      // Use data_transformer to infer the expected blob shape from datum.
-      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-      this->transformed_data_.Reshape(top_shape);
-      // Reshape batch according to the batch_size.
-      top_shape[0] = batch_size;
-      batch->data_.Reshape(top_shape);
+    if (cache_slots_ > 0) {
+      cached[item_id] = FindInCache(&cache_fills[item_id]);
+      if (cached[item_id] >= 0) {
+        ++cache_hits;
+        Next();
+        continue;
+      }
     }
-
-    // Apply data transformations (mirror, scale, crop...)
-    timer.Start();
-    int offset = batch->data_.offset(item_id);
-    Dtype* top_data = batch->data_.mutable_cpu_data();
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      Dtype* top_label = batch->label_.mutable_cpu_data();
-      top_label[item_id] = datum.label();
+    if (stable_values) {
+      values[item_id] = Value(cursor_->value_data(), cursor_->value_size());
+    } else {
+      string& buffer = value_buffers_[item_id];
+      buffer.assign(cursor_->value_data(), cursor_->value_size());
+      values[item_id] = Value(buffer.data(), buffer.size());
     }
-    trans_time += timer.MicroSeconds();
     Next();
   }
+  // The arena is done growing for this batch.
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    const int slot = cached[item_id];
+    if (slot >= 0) {
+      values[item_id] = Value(&cache_arena_[slot * cache_slot_size_],
+          cache_sizes_[slot]);
+    }
+  }
+  // Reshape according to the first datum of each batch
+  // on single input batches allows for inputs of varying dimension.
+  // Use data_transformer to infer the expected blob shape from datum.
+  Datum datum;
+  datum.ParseFromArray(values[0].first, values[0].second);
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+  this->transformed_data_.Reshape(top_shape);
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+  read_time += timer.MicroSeconds();
+
+  // Apply data transformations (mirror, scale, crop...)
+  timer.Start();
+  Dtype* top_label = NULL;
+  if (this->output_labels_) {
+    top_label = batch->label_.mutable_cpu_data();
+  }
+  this->TransformItems(batch_size, boost::bind(&DataLayer<Dtype>::TransformItem,
+      this, boost::cref(values), boost::cref(cache_fills),
+      batch->data_.mutable_cpu_data(), top_label, _1, _2, _3));
+  trans_time += timer.MicroSeconds();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    const int slot = cache_fills[item_id];
+    if (slot < 0) {
+      continue;
+    }
+    if (cache_sizes_[slot] > 0) {
+      cache_[cache_keys_[slot]].ready = true;
+    } else {
+      // It did not fit; free the slot for the next sample.
+      cache_.erase(cache_keys_[slot]);
+      cache_keys_[slot].clear();
+      cache_lru_.splice(cache_lru_.begin(), cache_lru_, cache_uses_[slot]);
+    }
+  }
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  DLOG_IF(INFO, cache_slots_ > 0) << "    Cache hits: " << cache_hits;
+}
+
+// This function may be called on several threads at once
+template<typename Dtype>
+void DataLayer<Dtype>::TransformItem(const vector<Value>& values,
+    const vector<int>& cache_fills, Dtype* top_data, Dtype* top_label,
+    int item_id, DataTransformer<Dtype>* transformer,
+    Blob<Dtype>* transformed_blob) {
+  Datum datum;
+  datum.ParseFromArray(values[item_id].first, values[item_id].second);
+  const int cache_slot = cache_fills[item_id];
+  if (cache_slot >= 0) {
+    // Keep the decoded datum, which is then transformed the same as the
+    // cached one will be.
+    DecodeForCache(&datum);
+    const int size = datum.ByteSize();
+    if (datum.float_data_size() == 0 && size <= cache_slot_size_) {
+      datum.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(
+          &cache_arena_[cache_slot * cache_slot_size_]));
+      cache_sizes_[cache_slot] = size;
+    } else {
+      cache_sizes_[cache_slot] = 0;
+    }
+  }
+  const int offset = item_id * transformed_blob->count();
+  transformed_blob->set_cpu_data(top_data + offset);
+  transformer->Transform(datum, transformed_blob);
+  // Copy label.
+  if (top_label) {
+    top_label[item_id] = datum.label();
+  }
 }
 
 INSTANTIATE_CLASS(DataLayer);
@@ -0,0 +1,78 @@
+#include <vector>
+
+#include "caffe/layers/depthwise_conv_layer.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  use_direct_ = this->num_spatial_axes_ == 2 && !this->force_nd_im2col_
+      && this->group_ == this->channels_;
+}
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_direct_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int stride_h = this->stride_.cpu_data()[0];
+  const int stride_w = this->stride_.cpu_data()[1];
+  const int dilation_h = this->dilation_.cpu_data()[0];
+  const int dilation_w = this->dilation_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  // Each input channel feeds multiplier consecutive output channels.
+  const int multiplier = this->num_output_ / this->group_;
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const bool fused_relu = this->fused_relu_;
+  const Dtype negative_slope = this->fused_relu_negative_slope_;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    CAFFE_PARALLEL_FOR
+    for (int nk = 0; nk < this->num_ * this->num_output_; ++nk) {
+      const int n = nk / this->num_output_;
+      const int k = nk % this->num_output_;
+      const Dtype* plane =
+          bottom_data + (n * this->channels_ + k / multiplier) * height * width;
+      const Dtype* filter = weight + k * kernel_h * kernel_w;
+      Dtype* output = top_data + nk * output_h * output_w;
+      for (int oh = 0; oh < output_h; ++oh) {
+        for (int ow = 0; ow < output_w; ++ow) {
+          Dtype sum = bias ? bias[k] : Dtype(0);
+          for (int kh = 0; kh < kernel_h; ++kh) {
+            const int h = oh * stride_h - pad_h + kh * dilation_h;
+            if (h < 0 || h >= height) {
+              continue;
+            }
+            for (int kw = 0; kw < kernel_w; ++kw) {
+              const int w = ow * stride_w - pad_w + kw * dilation_w;
+              if (w >= 0 && w < width) {
+                sum += plane[h * width + w] * filter[kh * kernel_w + kw];
+              }
+            }
+          }
+          if (fused_relu && sum < 0) {
+            sum *= negative_slope;
+          }
+          output[oh * output_w + ow] = sum;
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DepthwiseConvolutionLayer);
+
+}  // namespace caffe
@@ -73,6 +73,7 @@ void EltwiseLayer<Dtype>::Forward_cpu(
     // bottom 0 & 1
     bottom_data_a = bottom[0]->cpu_data();
     bottom_data_b = bottom[1]->cpu_data();
+    CAFFE_PARALLEL_FOR_IF(count >= CAFFE_PARALLEL_MIN_COUNT)
     for (int idx = 0; idx < count; ++idx) {
       if (bottom_data_a[idx] > bottom_data_b[idx]) {
         top_data[idx] = bottom_data_a[idx];  // maxval
@@ -85,6 +86,7 @@ void EltwiseLayer<Dtype>::Forward_cpu(
     // bottom 2++
     for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
       bottom_data_b = bottom[blob_idx]->cpu_data();
+      CAFFE_PARALLEL_FOR_IF(count >= CAFFE_PARALLEL_MIN_COUNT)
       for (int idx = 0; idx < count; ++idx) {
         if (bottom_data_b[idx] > top_data[idx]) {
           top_data[idx] = bottom_data_b[idx];  // maxval
@@ -137,6 +139,7 @@ void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         break;
       case EltwiseParameter_EltwiseOp_MAX:
         mask = max_idx_.cpu_data();
+        CAFFE_PARALLEL_FOR_IF(count >= CAFFE_PARALLEL_MIN_COUNT)
         for (int index = 0; index < count; ++index) {
           Dtype gradient = 0;
           if (mask[index] == i) {
@@ -1,12 +1,12 @@
 #ifdef USE_HDF5
 /*
 TODO:
-- load file in a separate thread ("prefetch")
 - can be smarter about the memcpy call instead of doing it row-by-row
   :: use util functions caffe_copy, and Blob->offset()
   :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
 */
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -17,37 +17,46 @@ TODO:
 
 #include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
+// The generator of rng, to shuffle with.
+static rng_t* generator(const shared_ptr<Caffe::RNG>& rng) {
+  return static_cast<rng_t*>(rng->generator());
+}
+
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+}
 
 // Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-  if (file_id < 0) {
-    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
-  }
-
   int top_size = this->layer_param_.top_size();
   hdf_blobs_.resize(top_size);
 
   const int MIN_DATA_DIM = 1;
   const int MAX_DATA_DIM = INT_MAX;
 
-  for (int i = 0; i < top_size; ++i) {
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-    // Allow reshape here, as we are loading data not params
-    hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-        MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get(), true);
+  {
+    HDF5Lock lock;
+    hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+      LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+    }
+    for (int i = 0; i < top_size; ++i) {
+      hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
+      // Allow reshape here, as we are loading data not params
+      hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
+          MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get(), true);
+    }
+    herr_t status = H5Fclose(file_id);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
   }
 
-  herr_t status = H5Fclose(file_id);
-  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
-
   // MinTopBlobs==1 guarantees at least one top blob
   CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
   const int num = hdf_blobs_[0]->shape(0);
@@ -62,7 +71,8 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
 
   // Shuffle if needed.
   if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+    shuffle(data_permutation_.begin(), data_permutation_.end(),
+        generator(row_rng_));
     DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0)
                << " rows (shuffled)";
   } else {
@@ -105,11 +115,33 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   // Shuffle if needed.
   if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+    file_rng_.reset(new Caffe::RNG(caffe_rng_rand()));
+    row_rng_.reset(new Caffe::RNG(caffe_rng_rand()));
+    shuffle(file_permutation_.begin(), file_permutation_.end(),
+        generator(file_rng_));
   }
 
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
+  const int chunk_size = this->layer_param_.hdf5_data_param().chunk_size();
+  if (chunk_size > 0) {
+    // Stream the files, starting with the first chunk.
+    const int num_chunks = this->layer_param_.hdf5_data_param().prefetch() + 1;
+    chunks_.resize(num_chunks);
+    for (int i = 0; i < num_chunks; ++i) {
+      chunks_[i].resize(this->layer_param_.top_size());
+      for (int j = 0; j < chunks_[i].size(); ++j) {
+        chunks_[i][j].reset(new Blob<Dtype>());
+      }
+      chunk_free_.push(i);
+    }
+    LOG(INFO) << "Streaming HDF5 files in chunks of " << chunk_size
+        << " rows";
+    StartInternalThread();
+    NextChunk();
+  } else {
+    // Load the first HDF5 file.
+    LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
+  }
+  // Initialize the line counter.
   current_row_ = 0;
 
   // Reshape blobs.
@@ -126,6 +158,98 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::NextChunk() {
+  if (current_chunk_ >= 0) {
+    chunk_free_.push(current_chunk_);
+  }
+  current_chunk_ = chunk_full_.pop("Waiting for HDF5 data");
+  hdf_blobs_ = chunks_[current_chunk_];
+  data_permutation_.resize(hdf_blobs_[0]->shape(0));
+  for (int i = 0; i < data_permutation_.size(); ++i) {
+    data_permutation_[i] = i;
+  }
+  if (this->layer_param_.hdf5_data_param().shuffle()) {
+    shuffle(data_permutation_.begin(), data_permutation_.end(),
+        generator(row_rng_));
+  }
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      const string& filename = hdf_filenames_[file_permutation_[current_file_]];
+      DLOG(INFO) << "Streaming HDF5 file: " << filename;
+      // Only held for each call, as ReadChunks waits for free slots.
+      hid_t file_id;
+      {
+        HDF5Lock lock;
+        file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+      }
+      if (file_id < 0) {
+        LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+      }
+      try {
+        ReadChunks(file_id);
+      } catch (boost::thread_interrupted&) {
+        HDF5Lock lock;
+        H5Fclose(file_id);
+        throw;
+      }
+      herr_t status;
+      {
+        HDF5Lock lock;
+        status = H5Fclose(file_id);
+      }
+      CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+      if (++current_file_ == num_files_) {
+        current_file_ = 0;
+        if (this->layer_param_.hdf5_data_param().shuffle()) {
+          shuffle(file_permutation_.begin(), file_permutation_.end(),
+              generator(file_rng_));
+        }
+        DLOG(INFO) << "Looping around to first file.";
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+// Reads the chunks of a file into free slots, in order or shuffled.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::ReadChunks(hid_t file_id) {
+  const int top_size = this->layer_param_.top_size();
+  const hsize_t num = hdf5_get_num_rows(file_id,
+      this->layer_param_.top(0).c_str());
+  CHECK_GT(num, 0) << "Input must have at least 1 row.";
+  for (int i = 1; i < top_size; ++i) {
+    CHECK_EQ(hdf5_get_num_rows(file_id, this->layer_param_.top(i).c_str()),
+        num);
+  }
+  const int MIN_DATA_DIM = 1;
+  const int MAX_DATA_DIM = INT_MAX;
+  const hsize_t chunk_size = this->layer_param_.hdf5_data_param().chunk_size();
+  vector<hsize_t> starts;
+  for (hsize_t start = 0; start < num; start += chunk_size) {
+    starts.push_back(start);
+  }
+  if (this->layer_param_.hdf5_data_param().shuffle()) {
+    shuffle(starts.begin(), starts.end(), generator(file_rng_));
+  }
+  for (int c = 0; c < starts.size(); ++c) {
+    const int slot = chunk_free_.pop();
+    const hsize_t count = std::min(chunk_size, num - starts[c]);
+    for (int i = 0; i < top_size; ++i) {
+      hdf5_load_nd_dataset_rows(file_id, this->layer_param_.top(i).c_str(),
+          MIN_DATA_DIM, MAX_DATA_DIM, starts[c], count,
+          chunks_[slot][i].get());
+    }
+    chunk_full_.push(slot);
+  }
+}
+
 template <typename Dtype>
 bool HDF5DataLayer<Dtype>::Skip() {
   int size = Caffe::solver_count();
@@ -139,13 +263,15 @@ bool HDF5DataLayer<Dtype>::Skip() {
 template<typename Dtype>
 void HDF5DataLayer<Dtype>::Next() {
   if (++current_row_ == hdf_blobs_[0]->shape(0)) {
-    if (num_files_ > 1) {
+    if (!chunks_.empty()) {
+      NextChunk();
+    } else if (num_files_ > 1) {
       ++current_file_;
       if (current_file_ == num_files_) {
         current_file_ = 0;
         if (this->layer_param_.hdf5_data_param().shuffle()) {
-          std::random_shuffle(file_permutation_.begin(),
-                              file_permutation_.end());
+          shuffle(file_permutation_.begin(), file_permutation_.end(),
+              generator(file_rng_));
         }
         DLOG(INFO) << "Looping around to first file.";
       }
@@ -154,7 +280,8 @@ void HDF5DataLayer<Dtype>::Next() {
     }
     current_row_ = 0;
     if (this->layer_param_.hdf5_data_param().shuffle())
-      std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+      shuffle(data_permutation_.begin(), data_permutation_.end(),
+          generator(row_rng_));
   }
   offset_++;
 }
@@ -1,4 +1,5 @@
 #ifdef USE_HDF5
+#include <boost/thread.hpp>
 #include <vector>
 
 #include "hdf5.h"
@@ -13,26 +14,106 @@ template <typename Dtype>
 void HDF5OutputLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   file_name_ = this->layer_param_.hdf5_output_param().file_name();
-  file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
-                       H5P_DEFAULT);
+  {
+    HDF5Lock lock;
+    file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+                         H5P_DEFAULT);
+  }
   CHECK_GE(file_id_, 0) << "Failed to open HDF5 file" << file_name_;
   file_opened_ = true;
+  const HDF5OutputParameter& param = this->layer_param_.hdf5_output_param();
+  if (param.append()) {
+    CHECK_GT(param.write_buffers(), 0);
+    CHECK_LE(param.compression(), 9) << "gzip levels go from 1 to 9";
+    for (int i = 0; i < param.write_buffers(); ++i) {
+      data_buffers_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      label_buffers_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      write_free_.push(i);
+    }
+    StartInternalThread();
+  }
 }
 
 template <typename Dtype>
 HDF5OutputLayer<Dtype>::~HDF5OutputLayer<Dtype>() {
+  // Write what is left before closing the file.
+  Flush();
+  this->StopInternalThread();
   if (file_opened_) {
+    HDF5Lock lock;
     herr_t status = H5Fclose(file_id_);
     CHECK_GE(status, 0) << "Failed to close HDF5 file " << file_name_;
   }
 }
 
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::Flush() {
+  if (!this->is_started()) {
+    return;
+  }
+  // Buffers are free once written.
+  for (int i = 0; i < data_buffers_.size(); ++i) {
+    write_free_.pop("Waiting for HDF5 writes");
+  }
+  for (int i = 0; i < data_buffers_.size(); ++i) {
+    write_free_.push(i);
+  }
+}
+
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::InternalThreadEntry() {
+  const HDF5OutputParameter& param = this->layer_param_.hdf5_output_param();
+  try {
+    while (!must_stop()) {
+      const int slot = write_full_.pop();
+      const Blob<Dtype>& data = *data_buffers_[slot];
+      const Blob<Dtype>& label = *label_buffers_[slot];
+      // Other layers and threads may be using libhdf5 meanwhile.
+      HDF5Lock lock;
+      if (!datasets_created_) {
+        const hsize_t chunk_rows =
+            param.chunk_rows() > 0 ? param.chunk_rows() : data.shape(0);
+        vector<int> data_shape(data.shape().begin() + 1, data.shape().end());
+        vector<int> label_shape(label.shape().begin() + 1,
+            label.shape().end());
+        hdf5_create_extendible_dataset<Dtype>(file_id_,
+            HDF5_DATA_DATASET_NAME, data_shape, chunk_rows,
+            param.compression());
+        hdf5_create_extendible_dataset<Dtype>(file_id_,
+            HDF5_DATA_LABEL_NAME, label_shape, chunk_rows,
+            param.compression());
+        datasets_created_ = true;
+      }
+      hdf5_append_nd_dataset(file_id_, HDF5_DATA_DATASET_NAME, data);
+      hdf5_append_nd_dataset(file_id_, HDF5_DATA_LABEL_NAME, label);
+      DLOG(INFO) << "Appended " << data.shape(0) << " rows to " << file_name_;
+      write_free_.push(slot);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 template <typename Dtype>
 void HDF5OutputLayer<Dtype>::SaveBlobs() {
   // TODO: no limit on the number of blobs
-  LOG(INFO) << "Saving HDF5 file " << file_name_;
   CHECK_EQ(data_blob_.num(), label_blob_.num()) <<
       "data blob and label blob must have the same batch size";
+  if (this->layer_param_.hdf5_output_param().append()) {
+    // Hand copies of the blobs over to the writer.
+    const int slot = write_free_.pop("Waiting for HDF5 writes");
+    Blob<Dtype>* data = data_buffers_[slot].get();
+    Blob<Dtype>* label = label_buffers_[slot].get();
+    data->ReshapeLike(data_blob_);
+    label->ReshapeLike(label_blob_);
+    caffe_copy(data_blob_.count(), data_blob_.cpu_data(),
+        data->mutable_cpu_data());
+    caffe_copy(label_blob_.count(), label_blob_.cpu_data(),
+        label->mutable_cpu_data());
+    write_full_.push(slot);
+    return;
+  }
+  LOG(INFO) << "Saving HDF5 file " << file_name_;
   hdf5_save_nd_dataset(file_id_, HDF5_DATA_DATASET_NAME, data_blob_);
   hdf5_save_nd_dataset(file_id_, HDF5_DATA_LABEL_NAME, label_blob_);
   LOG(INFO) << "Successfully saved " << data_blob_.num() << " rows";
@@ -1,4 +1,6 @@
 #ifdef USE_OPENCV
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <opencv2/core/core.hpp>
 
 #include <fstream>  // NOLINT(readability/streams)
@@ -20,6 +22,10 @@ namespace caffe {
 template <typename Dtype>
 ImageDataLayer<Dtype>::~ImageDataLayer<Dtype>() {
   this->StopInternalThread();
+  if (reader_) {
+    reader_->interrupt();
+    reader_->join();
+  }
 }
 
 template <typename Dtype>
@@ -96,6 +102,16 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < this->prefetch_.size(); ++i) {
     this->prefetch_[i]->label_.Reshape(label_shape);
   }
+  const int read_ahead = this->layer_param_.image_data_param().read_ahead();
+  files_.resize(batch_size + read_ahead);
+  if (read_ahead > 0) {
+    // From now on only the reader moves through the lines.
+    for (int i = 0; i < files_.size(); ++i) {
+      read_free_.push(i);
+    }
+    reader_.reset(new boost::thread(&ImageDataLayer<Dtype>::ReadAheadEntry,
+        this));
+  }
 }
 
 template <typename Dtype>
@@ -105,6 +121,41 @@ void ImageDataLayer<Dtype>::ShuffleImages() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+template <typename Dtype>
+void ImageDataLayer<Dtype>::ReadNextFile(ImageFile* file) {
+  const int lines_size = lines_.size();
+  CHECK_GT(lines_size, lines_id_);
+  const string& root_folder =
+      this->layer_param_.image_data_param().root_folder();
+  file->name = lines_[lines_id_].first;
+  file->label = lines_[lines_id_].second;
+  CHECK(ReadFileToString(root_folder + file->name, &file->data))
+      << "Could not load " << file->name;
+  // go to the next iter
+  lines_id_++;
+  if (lines_id_ >= lines_size) {
+    // We have reached the end. Restart from the first.
+    DLOG(INFO) << "Restarting data prefetching from start.";
+    lines_id_ = 0;
+    if (this->layer_param_.image_data_param().shuffle()) {
+      ShuffleImages();
+    }
+  }
+}
+
+template <typename Dtype>
+void ImageDataLayer<Dtype>::ReadAheadEntry() {
+  try {
+    while (true) {
+      const int slot = read_free_.pop();
+      ReadNextFile(&files_[slot]);
+      read_full_.push(slot);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 // This function is called on prefetch thread
 template <typename Dtype>
 void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -117,16 +168,28 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(this->transformed_data_.count());
   ImageDataParameter image_data_param = this->layer_param_.image_data_param();
   const int batch_size = image_data_param.batch_size();
-  const int new_height = image_data_param.new_height();
-  const int new_width = image_data_param.new_width();
-  const bool is_color = image_data_param.is_color();
-  string root_folder = image_data_param.root_folder();
+
+  // Take the files of the batch from the reader, or read them now.
+  timer.Start();
+  vector<int> slots(batch_size);
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    if (reader_) {
+      slots[item_id] = read_full_.pop("Waiting for image files");
+    } else {
+      slots[item_id] = item_id;
+      ReadNextFile(&files_[item_id]);
+    }
+  }
+  read_time += timer.MicroSeconds();
 
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+  timer.Start();
+  const ImageFile& first_file = files_[slots[0]];
+  cv::Mat cv_img = DecodeImageToCVMat(first_file.data,
+      image_data_param.new_height(), image_data_param.new_width(),
+      image_data_param.is_color(), image_data_param.reduced_decode());
+  CHECK(cv_img.data) << "Could not load " << first_file.name;
   // Use data_transformer to infer the expected blob shape from a cv_img.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
   this->transformed_data_.Reshape(top_shape);
@@ -134,44 +197,45 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
 
+  // Decode and apply transformations (mirror, crop...) to the images
   Dtype* prefetch_data = batch->data_.mutable_cpu_data();
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
-
-  // datum scales
-  const int lines_size = lines_.size();
+  this->TransformItems(batch_size, boost::bind(
+      &ImageDataLayer<Dtype>::DecodeItem, this, boost::cref(slots),
+      boost::cref(cv_img), prefetch_data, _1, _2, _3));
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
-    CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
-    prefetch_label[item_id] = lines_[lines_id_].second;
-    // go to the next iter
-    lines_id_++;
-    if (lines_id_ >= lines_size) {
-      // We have reached the end. Restart from the first.
-      DLOG(INFO) << "Restarting data prefetching from start.";
-      lines_id_ = 0;
-      if (this->layer_param_.image_data_param().shuffle()) {
-        ShuffleImages();
-      }
+    prefetch_label[item_id] = files_[slots[item_id]].label;
+    if (reader_) {
+      read_free_.push(slots[item_id]);
     }
   }
+  trans_time += timer.MicroSeconds();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function may be called on several threads at once
+template <typename Dtype>
+void ImageDataLayer<Dtype>::DecodeItem(const vector<int>& slots,
+    const cv::Mat& first_img, Dtype* top_data, int item_id,
+    DataTransformer<Dtype>* transformer, Blob<Dtype>* transformed_blob) {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
+  const ImageFile& file = files_[slots[item_id]];
+  cv::Mat cv_img = first_img;
+  if (item_id > 0) {
+    cv_img = DecodeImageToCVMat(file.data, image_data_param.new_height(),
+        image_data_param.new_width(), image_data_param.is_color(),
+        image_data_param.reduced_decode());
+    CHECK(cv_img.data) << "Could not load " << file.name;
+  }
+  const int offset = item_id * transformed_blob->count();
+  transformed_blob->set_cpu_data(top_data + offset);
+  transformer->Transform(cv_img, transformed_blob);
+}
+
 INSTANTIATE_CLASS(ImageDataLayer);
 REGISTER_LAYER_CLASS(ImageData);
 
@@ -2,6 +2,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -12,6 +13,12 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   transpose_ = this->layer_param_.inner_product_param().transpose();
+  int8_ = this->layer_param_.has_quantization_param();
+  int8_weight_source_.reset();
+  weight_storage_ = this->layer_param_.weight_storage();
+  CHECK(!int8_ || weight_storage_ == FLOAT32)
+      << "weight_storage does not apply to int8 (quantization_param).";
+  half_weight_source_.reset();
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -83,6 +90,14 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (int8_) {
+    Forward_cpu_int8(bottom, top);
+    return;
+  }
+  if (weight_storage_ != FLOAT32) {
+    Forward_cpu_half(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
@@ -96,6 +111,96 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::Forward_cpu_int8(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Quantize the weights again whenever they may have been written to or
+  // replaced since, as by CopyTrainedLayersFrom or ShareTrainedLayersWith.
+  const shared_ptr<SyncedMemory>& weight_data = this->blobs_[0]->data();
+  if (int8_weight_source_ != weight_data ||
+      int8_weight_version_ != weight_data->version()) {
+    // Quantize each output's weights on their own, from N_ x K_ rows.
+    vector<Dtype> weight_rows;
+    const Dtype* weight = output_weights(&weight_rows);
+    int8_weight_.resize(N_ * K_);
+    int8_weight_scale_.resize(N_);
+    caffe_cpu_quantize_rows_int8(N_, K_, weight, &int8_weight_[0],
+        &int8_weight_scale_[0]);
+    int8_weight_source_ = weight_data;
+    int8_weight_version_ = weight_data->version();
+  }
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const int count = bottom[0]->count();
+  Dtype bottom_max = this->layer_param_.quantization_param().bottom_max();
+  if (bottom_max <= 0) {
+    bottom_max = caffe_cpu_amax(count, bottom_data);
+  }
+  const Dtype bottom_scale = bottom_max > 0 ? bottom_max / 127 : Dtype(1);
+  int8_bottom_.resize(count);
+  int8_top_.resize(M_ * N_);
+  caffe_cpu_quantize_int8(count, bottom_scale, bottom_data, &int8_bottom_[0]);
+  caffe_cpu_gemm_int8(CblasTrans, M_, N_, K_, &int8_bottom_[0],
+      &int8_weight_[0], &int8_top_[0]);
+  // Scale the int32 results back, and add the bias in the same pass.
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int m = 0; m < M_; ++m) {
+    for (int n = 0; n < N_; ++n) {
+      top_data[m * N_ + n] = int8_top_[m * N_ + n]
+          * (bottom_scale * int8_weight_scale_[n]) + (bias ? bias[n] : 0);
+    }
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::Forward_cpu_half(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Convert the weights again whenever they may have changed, see
+  // Forward_cpu_int8.
+  const shared_ptr<SyncedMemory>& weight_data = this->blobs_[0]->data();
+  if (half_weight_source_ != weight_data ||
+      half_weight_version_ != weight_data->version()) {
+    vector<Dtype> weight_rows;
+    half_weight_.resize(N_ * K_);
+    caffe_cpu_to_half(N_ * K_, output_weights(&weight_rows), weight_storage_,
+        &half_weight_[0]);
+    half_weight_source_ = weight_data;
+    half_weight_version_ = weight_data->version();
+  }
+  // The product comes out as N_ x M_, the transpose of top, which has the
+  // same layout for a single input.
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  Dtype* product = top_data;
+  if (M_ > 1) {
+    half_top_.resize(N_ * M_);
+    product = &half_top_[0];
+  }
+  caffe_cpu_half_gemm(CblasTrans, N_, M_, K_, &half_weight_[0],
+      weight_storage_, bottom[0]->cpu_data(), product);
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int m = 0; m < M_; ++m) {
+    for (int n = 0; n < N_; ++n) {
+      top_data[m * N_ + n] = product[n * M_ + m] + (bias ? bias[n] : 0);
+    }
+  }
+}
+
+template <typename Dtype>
+const Dtype* InnerProductLayer<Dtype>::output_weights(
+    vector<Dtype>* weight_rows) const {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (!transpose_) {
+    return weight;
+  }
+  weight_rows->resize(N_ * K_);
+  for (int n = 0; n < N_; ++n) {
+    for (int k = 0; k < K_; ++k) {
+      (*weight_rows)[n * K_ + k] = weight[k * N_ + n];
+    }
+  }
+  return &(*weight_rows)[0];
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
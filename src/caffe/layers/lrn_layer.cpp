@@ -104,6 +104,16 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// y += a * x, as a plain loop for the threads of CAFFE_PARALLEL_FOR, which
+// must not call BLAS.
+template <typename Dtype>
+static inline void lrn_axpy(const int n, const Dtype a, const Dtype* x,
+    Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] += a * x[i];
+  }
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -111,38 +121,40 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
   Dtype* top_data = top[0]->mutable_cpu_data();
   Dtype* scale_data = scale_.mutable_cpu_data();
   // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
+  caffe_set(scale_.count(), k_, scale_data);
+  const int spatial_dim = height_ * width_;
+  const int padded_count = (channels_ + size_ - 1) * spatial_dim;
   Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
+  // go through the images; each one gets its own padded square buffer so
+  // that the images can be normalized in parallel. The scratch is a plain
+  // vector rather than a Blob so worker threads never touch Caffe::Get().
+  CAFFE_PARALLEL_FOR_IF(num_ > 1)
   for (int n = 0; n < num_; ++n) {
+    vector<Dtype> padded_square(padded_count, Dtype(0));
+    Dtype* padded_square_data = &padded_square[0];
+    Dtype* image_scale_data = scale_data + scale_.offset(n);
     // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
+    caffe_sqr(channels_ * spatial_dim,
         bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
+        padded_square_data + pre_pad_ * spatial_dim);
     // Create the first channel scale
     for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
+      lrn_axpy<Dtype>(spatial_dim, alpha_over_size,
+          padded_square_data + c * spatial_dim, image_scale_data);
     }
     for (int c = 1; c < channels_; ++c) {
       // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
+      caffe_copy<Dtype>(spatial_dim,
+          image_scale_data + (c - 1) * spatial_dim,
+          image_scale_data + c * spatial_dim);
       // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
+      lrn_axpy<Dtype>(spatial_dim, alpha_over_size,
+          padded_square_data + (c + size_ - 1) * spatial_dim,
+          image_scale_data + c * spatial_dim);
       // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+      lrn_axpy<Dtype>(spatial_dim, -alpha_over_size,
+          padded_square_data + (c - 1) * spatial_dim,
+          image_scale_data + c * spatial_dim);
     }
   }
 
@@ -185,48 +197,49 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* scale_data = scale_.cpu_data();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
-  Blob<Dtype> accum_ratio(1, 1, height_, width_);
-  Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
-  Dtype* accum_ratio_data = accum_ratio.mutable_cpu_data();
-  // We hack a little bit by using the diff() to store an additional result
-  Dtype* accum_ratio_times_bottom = accum_ratio.mutable_cpu_diff();
-  caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
+  const int spatial_dim = height_ * width_;
+  const int padded_count = (channels_ + size_ - 1) * spatial_dim;
   Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
 
   caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
   caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
 
-  // go through individual data
+  // go through individual data, in parallel with per-image scratch
   int inverse_pre_pad = size_ - (size_ + 1) / 2;
+  CAFFE_PARALLEL_FOR_IF(num_ > 1)
   for (int n = 0; n < num_; ++n) {
+    vector<Dtype> padded_ratio(padded_count, Dtype(0));
+    // The second half holds accum_ratio * bottom for the current channel.
+    vector<Dtype> accum_ratio(2 * spatial_dim, Dtype(0));
+    Dtype* padded_ratio_data = &padded_ratio[0];
+    Dtype* accum_ratio_data = &accum_ratio[0];
+    Dtype* accum_ratio_times_bottom = accum_ratio_data + spatial_dim;
     int block_offset = scale_.offset(n);
     // first, compute diff_i * y_i / s_i
-    caffe_mul<Dtype>(channels_ * height_ * width_,
+    caffe_mul<Dtype>(channels_ * spatial_dim,
         top_diff + block_offset, top_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    caffe_div<Dtype>(channels_ * height_ * width_,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad),
+        padded_ratio_data + inverse_pre_pad * spatial_dim);
+    caffe_div<Dtype>(channels_ * spatial_dim,
+        padded_ratio_data + inverse_pre_pad * spatial_dim,
         scale_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
+        padded_ratio_data + inverse_pre_pad * spatial_dim);
     // Now, compute the accumulated ratios and the bottom diff
-    caffe_set(accum_ratio.count(), Dtype(0), accum_ratio_data);
     for (int c = 0; c < size_ - 1; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+      lrn_axpy<Dtype>(spatial_dim, 1.,
+          padded_ratio_data + c * spatial_dim, accum_ratio_data);
     }
     for (int c = 0; c < channels_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c + size_ - 1),
+      lrn_axpy<Dtype>(spatial_dim, 1.,
+          padded_ratio_data + (c + size_ - 1) * spatial_dim,
           accum_ratio_data);
       // compute bottom diff
-      caffe_mul<Dtype>(height_ * width_,
+      caffe_mul<Dtype>(spatial_dim,
           bottom_data + top[0]->offset(n, c),
           accum_ratio_data, accum_ratio_times_bottom);
-      caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
+      lrn_axpy<Dtype>(spatial_dim, -cache_ratio_value,
           accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
-      caffe_axpy<Dtype>(height_ * width_, -1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+      lrn_axpy<Dtype>(spatial_dim, -1.,
+          padded_ratio_data + c * spatial_dim, accum_ratio_data);
     }
   }
 }
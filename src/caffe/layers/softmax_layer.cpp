@@ -33,28 +33,40 @@ void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int dim = bottom[0]->count() / outer_num_;
   caffe_copy(bottom[0]->count(), bottom_data, top_data);
   // We need to subtract the max to avoid numerical issues, compute the exp,
-  // and then normalize.
+  // and then normalize. Each outer index uses its own inner_num_ slice of
+  // scale_ as scratch, so the outer loop runs across the intra-op threads.
+  // The sums are plain loops, as BLAS must not be called from those threads.
+  CAFFE_PARALLEL_FOR_IF(outer_num_ > 1)
   for (int i = 0; i < outer_num_; ++i) {
-    // initialize scale_data to the first plane
-    caffe_copy(inner_num_, bottom_data + i * dim, scale_data);
+    Dtype* scale_slice = scale_data + i * inner_num_;
+    Dtype* top_slice = top_data + i * dim;
+    // initialize scale_slice to the first plane
+    caffe_copy(inner_num_, bottom_data + i * dim, scale_slice);
     for (int j = 0; j < channels; j++) {
       for (int k = 0; k < inner_num_; k++) {
-        scale_data[k] = std::max(scale_data[k],
+        scale_slice[k] = std::max(scale_slice[k],
             bottom_data[i * dim + j * inner_num_ + k]);
       }
     }
     // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data);
+    for (int j = 0; j < channels; j++) {
+      for (int k = 0; k < inner_num_; k++) {
+        top_slice[j * inner_num_ + k] -= scale_slice[k];
+      }
+    }
     // exponentiation
-    caffe_exp<Dtype>(dim, top_data, top_data);
+    caffe_exp<Dtype>(dim, top_slice, top_slice);
     // sum after exp
-    caffe_cpu_gemv<Dtype>(CblasTrans, channels, inner_num_, 1.,
-        top_data, sum_multiplier_.cpu_data(), 0., scale_data);
+    caffe_set(inner_num_, Dtype(0), scale_slice);
+    for (int j = 0; j < channels; j++) {
+      for (int k = 0; k < inner_num_; k++) {
+        scale_slice[k] += top_slice[j * inner_num_ + k];
+      }
+    }
     // division
     for (int j = 0; j < channels; j++) {
-      caffe_div(inner_num_, top_data, scale_data, top_data);
-      top_data += inner_num_;
+      caffe_div(inner_num_, top_slice + j * inner_num_, scale_slice,
+          top_slice + j * inner_num_);
     }
   }
 }
@@ -70,16 +82,26 @@ void SoftmaxLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   int channels = top[0]->shape(softmax_axis_);
   int dim = top[0]->count() / outer_num_;
   caffe_copy(top[0]->count(), top_diff, bottom_diff);
+  CAFFE_PARALLEL_FOR_IF(outer_num_ > 1)
   for (int i = 0; i < outer_num_; ++i) {
-    // compute dot(top_diff, top_data) and subtract them from the bottom diff
-    for (int k = 0; k < inner_num_; ++k) {
-      scale_data[k] = caffe_cpu_strided_dot<Dtype>(channels,
-          bottom_diff + i * dim + k, inner_num_,
-          top_data + i * dim + k, inner_num_);
+    Dtype* scale_slice = scale_data + i * inner_num_;
+    Dtype* diff_slice = bottom_diff + i * dim;
+    const Dtype* data_slice = top_data + i * dim;
+    // compute dot(top_diff, top_data) and subtract them from the bottom diff,
+    // without BLAS as in Forward_cpu
+    caffe_set(inner_num_, Dtype(0), scale_slice);
+    for (int j = 0; j < channels; ++j) {
+      for (int k = 0; k < inner_num_; ++k) {
+        scale_slice[k] += diff_slice[j * inner_num_ + k]
+            * data_slice[j * inner_num_ + k];
+      }
     }
     // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_, 1,
-        -1., sum_multiplier_.cpu_data(), scale_data, 1., bottom_diff + i * dim);
+    for (int j = 0; j < channels; ++j) {
+      for (int k = 0; k < inner_num_; ++k) {
+        diff_slice[j * inner_num_ + k] -= scale_slice[k];
+      }
+    }
   }
   // elementwise multiplication
   caffe_mul(top[0]->count(), bottom_diff, top_data, bottom_diff);
@@ -0,0 +1,298 @@
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Transform matrices of F(2x2, 3x3) and F(4x4, 3x3), from Lavin and Gray,
+// "Fast Algorithms for Convolutional Neural Networks", CVPR 2016.
+static const double kWinogradG2[4 * 3] = {
+  1.0,  0.0, 0.0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0.0,  0.0, 1.0 };
+static const double kWinogradBT2[4 * 4] = {
+  1.0,  0.0, -1.0,  0.0,
+  0.0,  1.0,  1.0,  0.0,
+  0.0, -1.0,  1.0,  0.0,
+  0.0,  1.0,  0.0, -1.0 };
+static const double kWinogradAT2[2 * 4] = {
+  1.0, 1.0,  1.0,  0.0,
+  0.0, 1.0, -1.0, -1.0 };
+static const double kWinogradG4[6 * 3] = {
+  1.0 / 4.0,  0.0,        0.0,
+  -1.0 / 6.0, -1.0 / 6.0, -1.0 / 6.0,
+  -1.0 / 6.0,  1.0 / 6.0, -1.0 / 6.0,
+  1.0 / 24.0,  1.0 / 12.0, 1.0 / 6.0,
+  1.0 / 24.0, -1.0 / 12.0, 1.0 / 6.0,
+  0.0,         0.0,        1.0 };
+static const double kWinogradBT4[6 * 6] = {
+  4.0,  0.0, -5.0,  0.0, 1.0, 0.0,
+  0.0, -4.0, -4.0,  1.0, 1.0, 0.0,
+  0.0,  4.0, -4.0, -1.0, 1.0, 0.0,
+  0.0, -2.0, -1.0,  2.0, 1.0, 0.0,
+  0.0,  2.0, -1.0, -2.0, 1.0, 0.0,
+  0.0,  4.0,  0.0, -5.0, 0.0, 1.0 };
+static const double kWinogradAT4[4 * 6] = {
+  1.0, 1.0,  1.0, 1.0,  1.0, 0.0,
+  0.0, 1.0, -1.0, 2.0, -2.0, 0.0,
+  0.0, 1.0,  1.0, 4.0,  4.0, 0.0,
+  0.0, 1.0, -1.0, 8.0, -8.0, 1.0 };
+
+// Small dense products of row-major matrices, where A is rows x inner and
+// C is rows x cols: C = A * B with A a transform matrix, ...
+template <typename Dtype>
+static inline void winograd_gemm(const int rows, const int inner,
+    const int cols, const double* A, const Dtype* B, Dtype* C) {
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      Dtype sum = 0;
+      for (int i = 0; i < inner; ++i) {
+        sum += A[r * inner + i] * B[i * cols + c];
+      }
+      C[r * cols + c] = sum;
+    }
+  }
+}
+
+// ... and C = A * B^T with B a transform matrix.
+template <typename Dtype>
+static inline void winograd_gemm_nt(const int rows, const int inner,
+    const int cols, const Dtype* A, const double* B, Dtype* C) {
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      Dtype sum = 0;
+      for (int i = 0; i < inner; ++i) {
+        sum += A[r * inner + i] * B[c * inner + i];
+      }
+      C[r * cols + c] = sum;
+    }
+  }
+}
+
+template <typename Dtype>
+bool WinogradConvolutionLayer<Dtype>::IsSupported(
+    const ConvolutionParameter& conv_param) {
+  if (conv_param.force_nd_im2col()) {
+    return false;
+  }
+  if (conv_param.has_kernel_h() || conv_param.has_kernel_w()) {
+    if (conv_param.kernel_h() != 3 || conv_param.kernel_w() != 3) {
+      return false;
+    }
+  } else {
+    if (conv_param.kernel_size_size() == 0) {
+      return false;
+    }
+    for (int i = 0; i < conv_param.kernel_size_size(); ++i) {
+      if (conv_param.kernel_size(i) != 3) { return false; }
+    }
+  }
+  if (conv_param.has_stride_h() || conv_param.has_stride_w()) {
+    if (conv_param.stride_h() != 1 || conv_param.stride_w() != 1) {
+      return false;
+    }
+  }
+  for (int i = 0; i < conv_param.stride_size(); ++i) {
+    if (conv_param.stride(i) != 1) { return false; }
+  }
+  for (int i = 0; i < conv_param.dilation_size(); ++i) {
+    if (conv_param.dilation(i) != 1) { return false; }
+  }
+  return true;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  use_winograd_ = this->num_spatial_axes_ == 2 && IsSupported(conv_param);
+  if (!use_winograd_) {
+    return;
+  }
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  tile_ = (output_h >= 8 && output_w >= 8) ? 4 : 2;
+  tiles_h_ = (output_h + tile_ - 1) / tile_;
+  tiles_w_ = (output_w + tile_ - 1) / tile_;
+  const int alpha = tile_ + 2;
+  vector<int> shape(4);
+  shape[0] = this->group_;
+  shape[1] = alpha * alpha;
+  shape[2] = this->num_output_ / this->group_;
+  shape[3] = this->channels_ / this->group_;
+  weight_transform_.Reshape(shape);
+  shape[2] = this->channels_ / this->group_;
+  shape[3] = tiles_h_ * tiles_w_;
+  input_transform_.Reshape(shape);
+  shape[2] = this->num_output_ / this->group_;
+  output_transform_.Reshape(shape);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::transform_weights() {
+  const double* G = tile_ == 4 ? kWinogradG4 : kWinogradG2;
+  const int alpha = tile_ + 2;
+  const int tile_area = alpha * alpha;
+  const int out_per_group = this->num_output_ / this->group_;
+  const int in_per_group = this->channels_ / this->group_;
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* U = weight_transform_.mutable_cpu_data();
+  CAFFE_PARALLEL_FOR
+  for (int k = 0; k < this->num_output_; ++k) {
+    const int g = k / out_per_group;
+    const int k_g = k % out_per_group;
+    Dtype Gg[6 * 3];
+    Dtype u[6 * 6];
+    for (int c = 0; c < in_per_group; ++c) {
+      // u = G g G^T
+      winograd_gemm(alpha, 3, 3, G, weight + (k * in_per_group + c) * 9, Gg);
+      winograd_gemm_nt(alpha, 3, alpha, Gg, G, u);
+      for (int xi = 0; xi < tile_area; ++xi) {
+        U[((g * tile_area + xi) * out_per_group + k_g) * in_per_group + c] =
+            u[xi];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::transform_input(const Dtype* input) {
+  const double* BT = tile_ == 4 ? kWinogradBT4 : kWinogradBT2;
+  const int alpha = tile_ + 2;
+  const int tile_area = alpha * alpha;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int in_per_group = this->channels_ / this->group_;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  Dtype* V = input_transform_.mutable_cpu_data();
+  CAFFE_PARALLEL_FOR
+  for (int c = 0; c < this->channels_; ++c) {
+    const int g = c / in_per_group;
+    const int c_g = c % in_per_group;
+    const Dtype* plane = input + c * height * width;
+    Dtype d[6 * 6];
+    Dtype BTd[6 * 6];
+    Dtype v[6 * 6];
+    for (int th = 0; th < tiles_h_; ++th) {
+      for (int tw = 0; tw < tiles_w_; ++tw) {
+        // Gather the tile, zero-filling the padding.
+        const int h0 = th * tile_ - pad_h;
+        const int w0 = tw * tile_ - pad_w;
+        for (int i = 0; i < alpha; ++i) {
+          const int h = h0 + i;
+          for (int j = 0; j < alpha; ++j) {
+            const int w = w0 + j;
+            d[i * alpha + j] = (h >= 0 && h < height && w >= 0 && w < width) ?
+                plane[h * width + w] : Dtype(0);
+          }
+        }
+        // v = B^T d B
+        winograd_gemm(alpha, alpha, alpha, BT, d, BTd);
+        winograd_gemm_nt(alpha, alpha, alpha, BTd, BT, v);
+        const int p = th * tiles_w_ + tw;
+        for (int xi = 0; xi < tile_area; ++xi) {
+          V[((g * tile_area + xi) * in_per_group + c_g) * num_tiles + p] =
+              v[xi];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::transform_output(Dtype* output) {
+  const double* AT = tile_ == 4 ? kWinogradAT4 : kWinogradAT2;
+  const int alpha = tile_ + 2;
+  const int tile_area = alpha * alpha;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int out_per_group = this->num_output_ / this->group_;
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const Dtype* M = output_transform_.cpu_data();
+  CAFFE_PARALLEL_FOR
+  for (int k = 0; k < this->num_output_; ++k) {
+    const int g = k / out_per_group;
+    const int k_g = k % out_per_group;
+    Dtype* plane = output + k * output_h * output_w;
+    Dtype m[6 * 6];
+    Dtype ATm[4 * 6];
+    Dtype y[4 * 4];
+    for (int th = 0; th < tiles_h_; ++th) {
+      for (int tw = 0; tw < tiles_w_; ++tw) {
+        const int p = th * tiles_w_ + tw;
+        for (int xi = 0; xi < tile_area; ++xi) {
+          m[xi] = M[((g * tile_area + xi) * out_per_group + k_g) * num_tiles
+              + p];
+        }
+        // y = A^T m A
+        winograd_gemm(tile_, alpha, alpha, AT, m, ATm);
+        winograd_gemm_nt(tile_, alpha, tile_, ATm, AT, y);
+        // Scatter the tile, dropping the part that overhangs the output.
+        for (int i = 0; i < tile_ && th * tile_ + i < output_h; ++i) {
+          for (int j = 0; j < tile_ && tw * tile_ + j < output_w; ++j) {
+            plane[(th * tile_ + i) * output_w + tw * tile_ + j] =
+                y[i * tile_ + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  // The filters only change between solver iterations or when weights are
+  // loaded, so their transform is kept until the weights may have changed.
+  const shared_ptr<SyncedMemory>& weight = this->blobs_[0]->data();
+  if (transformed_tile_ != tile_ || transformed_weight_source_ != weight ||
+      transformed_weight_version_ != weight->version()) {
+    transform_weights();
+    transformed_tile_ = tile_;
+    transformed_weight_source_ = weight;
+    transformed_weight_version_ = weight->version();
+  }
+  const int tile_area = (tile_ + 2) * (tile_ + 2);
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int out_per_group = this->num_output_ / this->group_;
+  const int in_per_group = this->channels_ / this->group_;
+  const Dtype* U = weight_transform_.cpu_data();
+  const Dtype* V = input_transform_.cpu_data();
+  Dtype* M = output_transform_.mutable_cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      transform_input(bottom_data + n * this->bottom_dim_);
+      // One GEMM per group and tile element, issued serially: the BLAS is
+      // never called from the intra-op threads, see cpu_parallel_images.
+      for (int gx = 0; gx < this->group_ * tile_area; ++gx) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_per_group,
+            num_tiles, in_per_group, (Dtype)1.,
+            U + gx * out_per_group * in_per_group,
+            V + gx * in_per_group * num_tiles,
+            (Dtype)0., M + gx * out_per_group * num_tiles);
+      }
+      transform_output(top_data + n * this->top_dim_);
+      if (this->bias_term_) {
+        const Dtype* bias = this->blobs_[1]->cpu_data();
+        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+      }
+      this->forward_cpu_relu(top_data + n * this->top_dim_, this->top_dim_);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
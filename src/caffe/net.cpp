@@ -14,9 +14,12 @@
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fuse_layers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/flat_blobs.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/plan_in_place.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -50,6 +53,22 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   // the current NetState.
   NetParameter filtered_param;
   FilterNet(in_param, &filtered_param);
+  // Fold the layers that only transform a convolution's output into it.
+  if (filtered_param.fuse_layers()) {
+    CHECK_EQ(phase_, TEST) << "fuse_layers is only for TEST phase nets.";
+    NetParameter fused_param;
+    FuseLayers(filtered_param, &fused_param, &folded_layers_);
+    filtered_param.Swap(&fused_param);
+  }
+  // Let the layers that can run in-place do so, where nothing else needs
+  // their bottom blobs.
+  if (filtered_param.plan_in_place() == NetParameter_InPlacePlan_ALL_PHASES ||
+      (filtered_param.plan_in_place() == NetParameter_InPlacePlan_TEST_ONLY &&
+       phase_ == TEST)) {
+    NetParameter in_place_param;
+    PlanInPlace(filtered_param, &in_place_param);
+    filtered_param.Swap(&in_place_param);
+  }
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
@@ -61,6 +80,7 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   map<string, int> blob_name_to_idx;
   set<string> available_blobs;
   memory_used_ = 0;
+  workspace_.reset(new Blob<Dtype>());
   // For each layer, set up its input and output
   bottom_vecs_.resize(param.layer_size());
   top_vecs_.resize(param.layer_size());
@@ -120,6 +140,7 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     }
     // After this layer is connected, set it up.
+    layers_[layer_id]->SetSharedWorkspace(workspace_);
     layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     LOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
@@ -253,10 +274,156 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  flat_param_data_.reset();
+  flat_param_diff_.reset();
+  flat_params_count_ = 0;
+  if (param.flat_params()) {
+    flat_param_data_ = FlattenBlobs(learnable_params_, false);
+    flat_param_diff_ = FlattenBlobs(learnable_params_, true);
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      flat_params_count_ += learnable_params_[i]->count();
+    }
+  }
   debug_info_ = param.debug_info();
+  optimize_memory_ = param.optimize_memory();
+  if (optimize_memory_) {
+    CHECK_EQ(phase_, TEST) << "optimize_memory is only for TEST phase nets.";
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Memory required for data after optimization: "
+        << OptimizeMemory();
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+size_t Net<Dtype>::OptimizeMemory() {
+  // Group blobs that share storage through their layers, with union-find.
+  vector<int> group(blobs_.size());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    group[blob_id] = blob_id;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int t = 0; t < top_id_vecs_[layer_id].size(); ++t) {
+      const int top_id = top_id_vecs_[layer_id][t];
+      for (int b = 0; b < bottom_id_vecs_[layer_id].size(); ++b) {
+        const int bottom_id = bottom_id_vecs_[layer_id][b];
+        if (blobs_[top_id]->count() == 0 || blobs_[bottom_id]->count() == 0 ||
+            blobs_[top_id]->data() != blobs_[bottom_id]->data()) {
+          continue;
+        }
+        int top_root = top_id, bottom_root = bottom_id;
+        while (group[top_root] != top_root) { top_root = group[top_root]; }
+        while (group[bottom_root] != bottom_root) {
+          bottom_root = group[bottom_root];
+        }
+        group[std::max(top_root, bottom_root)] =
+            std::min(top_root, bottom_root);
+      }
+    }
+  }
+  // Find the layers spanned by each group and the largest blob in it. The
+  // outputs and the tops of layers without bottoms keep their own storage.
+  vector<int> first_layer(blobs_.size(), -1);
+  vector<int> last_layer(blobs_.size(), -1);
+  vector<size_t> group_size(blobs_.size(), 0);
+  vector<bool> fixed(blobs_.size(), false);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    while (group[group[blob_id]] != group[blob_id]) {
+      group[blob_id] = group[group[blob_id]];
+    }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    vector<int> blob_ids(bottom_id_vecs_[layer_id]);
+    blob_ids.insert(blob_ids.end(), top_id_vecs_[layer_id].begin(),
+        top_id_vecs_[layer_id].end());
+    for (int i = 0; i < blob_ids.size(); ++i) {
+      const int g = group[blob_ids[i]];
+      if (first_layer[g] < 0) {
+        first_layer[g] = layer_id;
+      }
+      last_layer[g] = layer_id;
+      group_size[g] = std::max(group_size[g],
+          blobs_[blob_ids[i]]->count() * sizeof(Dtype));
+    }
+    if (bottom_id_vecs_[layer_id].size() == 0) {
+      for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+        fixed[group[top_id_vecs_[layer_id][i]]] = true;
+      }
+    }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    fixed[group[net_output_blob_indices_[i]]] = true;
+  }
+  // Loss weighted tops carry their weights in the diff for Backward.
+  for (int blob_id = 0; blob_id < blob_loss_weights_.size(); ++blob_id) {
+    if (blob_loss_weights_[blob_id] != Dtype(0)) {
+      fixed[group[blob_id]] = true;
+    }
+  }
+  // Walk the layers in order, handing each group starting there the smallest
+  // free buffer that fits, or else growing the largest free one.
+  vector<int> buffer(blobs_.size(), -1);
+  vector<size_t> buffer_size;
+  vector<int> free_buffers;
+  size_t fixed_size = 0;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int g = 0; g < blobs_.size(); ++g) {
+      if (group[g] == g && buffer[g] >= 0 && last_layer[g] == layer_id - 1) {
+        free_buffers.push_back(buffer[g]);
+      }
+    }
+    for (int g = 0; g < blobs_.size(); ++g) {
+      if (group[g] != g || first_layer[g] != layer_id || group_size[g] == 0) {
+        continue;
+      }
+      if (fixed[g]) {
+        fixed_size += group_size[g];
+        continue;
+      }
+      int best = -1;
+      for (int i = 0; i < free_buffers.size(); ++i) {
+        const size_t size = buffer_size[free_buffers[i]];
+        if (best < 0) {
+          best = i;
+        } else if (size >= group_size[g]) {
+          const size_t best_size = buffer_size[free_buffers[best]];
+          if (best_size < group_size[g] || size < best_size) {
+            best = i;
+          }
+        } else if (size > buffer_size[free_buffers[best]]) {
+          best = i;
+        }
+      }
+      if (best < 0) {
+        buffer[g] = buffer_size.size();
+        buffer_size.push_back(group_size[g]);
+      } else {
+        buffer[g] = free_buffers[best];
+        free_buffers.erase(free_buffers.begin() + best);
+        buffer_size[buffer[g]] = std::max(buffer_size[buffer[g]],
+            group_size[g]);
+      }
+    }
+  }
+  vector<shared_ptr<SyncedMemory> > memory(buffer_size.size());
+  size_t planned_size = fixed_size;
+  for (int i = 0; i < buffer_size.size(); ++i) {
+    memory[i].reset(new SyncedMemory(buffer_size[i]));
+    planned_size += buffer_size[i];
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int b = buffer[group[blob_id]];
+    if (b >= 0 && blobs_[blob_id]->count() > 0) {
+      blobs_[blob_id]->ShareDataMemory(memory[b]);
+    }
+  }
+  // Let the layers re-establish any sharing of their own.
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+  }
+  return planned_size;
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -567,6 +734,7 @@ const vector<Blob<Dtype>*>& Net<Dtype>::Forward(
 
 template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
+  CHECK(!optimize_memory_) << "Backward is unavailable with optimize_memory.";
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
@@ -665,6 +833,7 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
 
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
@@ -675,24 +844,42 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       ++target_layer_id;
     }
     if (target_layer_id == layer_names_.size()) {
+      if (IsFoldedLayer(source_layer_name)) {
+        folded_blobs[source_layer_name] = source_layer->blobs();
+        continue;
+      }
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
+    // Folding rewrites a fused convolution's weights, so those are copied
+    // rather than shared, and folded again below.
+    const bool fused = folded_layers_.count(source_layer_name) > 0;
+    if (fused && source_layer->blobs().size() + 1 == target_blobs.size()) {
+      // A fused convolution without a bias of its own starts from zero.
+      caffe_set(target_blobs[1]->count(), static_cast<Dtype>(0),
+          target_blobs[1]->mutable_cpu_data());
+    } else {
+      CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
+    for (int j = 0; j < source_layer->blobs().size(); ++j) {
       Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
       CHECK(target_blobs[j]->shape() == source_blob->shape())
           << "Cannot share param " << j << " weights from layer '"
           << source_layer_name << "'; shape mismatch.  Source param shape is "
           << source_blob->shape_string() << "; target param shape is "
           << target_blobs[j]->shape_string();
-      target_blobs[j]->ShareData(*source_blob);
+      if (fused) {
+        target_blobs[j]->CopyFrom(*source_blob);
+      } else {
+        target_blobs[j]->ShareData(*source_blob);
+      }
     }
   }
+  FoldTrainedLayers(folded_blobs);
 }
 
 template <typename Dtype>
@@ -729,10 +916,48 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  if (optimize_memory_) {
+    OptimizeMemory();
+  }
+}
+
+template <typename Dtype>
+bool Net<Dtype>::IsFoldedLayer(const string& layer_name) const {
+  for (map<string, vector<LayerParameter> >::const_iterator it =
+       folded_layers_.begin(); it != folded_layers_.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      if (it->second[i].name() == layer_name) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <typename Dtype>
+void Net<Dtype>::FoldTrainedLayers(
+    const map<string, vector<shared_ptr<Blob<Dtype> > > >& folded_blobs) {
+  for (map<string, vector<LayerParameter> >::const_iterator it =
+       folded_layers_.begin(); it != folded_layers_.end(); ++it) {
+    const vector<shared_ptr<Blob<Dtype> > >& conv_blobs =
+        layers_[layer_names_index_[it->first]]->blobs();
+    // In order, as the folded layers were applied one after the other.
+    for (int i = 0; i < it->second.size(); ++i) {
+      const LayerParameter& folded_layer = it->second[i];
+      typename map<string, vector<shared_ptr<Blob<Dtype> > > >::const_iterator
+          blobs = folded_blobs.find(folded_layer.name());
+      if (blobs != folded_blobs.end()) {
+        DLOG(INFO) << "Folding source layer " << folded_layer.name()
+                   << " into " << it->first;
+        FoldIntoConvolution(folded_layer, blobs->second, conv_blobs);
+      }
+    }
+  }
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
@@ -743,15 +968,32 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       ++target_layer_id;
     }
     if (target_layer_id == layer_names_.size()) {
+      if (IsFoldedLayer(source_layer_name)) {
+        // Kept until all convolutions are copied, then folded into them.
+        vector<shared_ptr<Blob<Dtype> > >& blobs =
+            folded_blobs[source_layer_name];
+        for (int j = 0; j < source_layer.blobs_size(); ++j) {
+          blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          blobs.back()->FromProto(source_layer.blobs(j));
+        }
+        continue;
+      }
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
+    if (folded_layers_.count(source_layer_name) &&
+        source_layer.blobs_size() + 1 == target_blobs.size()) {
+      // A fused convolution without a bias of its own starts from zero.
+      caffe_set(target_blobs[1]->count(), static_cast<Dtype>(0),
+          target_blobs[1]->mutable_cpu_data());
+    } else {
+      CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
+    for (int j = 0; j < source_layer.blobs_size(); ++j) {
       if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
         Blob<Dtype> source_blob;
         const bool kReshape = true;
@@ -767,11 +1009,17 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
     }
   }
+  FoldTrainedLayers(folded_blobs);
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string& trained_filename) {
-  if (H5Fis_hdf5(trained_filename.c_str())) {
+  bool is_hdf5;
+  {
+    HDF5Lock lock;
+    is_hdf5 = H5Fis_hdf5(trained_filename.c_str());
+  }
+  if (is_hdf5) {
     CopyTrainedLayersFromHDF5(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
@@ -789,15 +1037,36 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string& trained_filename) {
 #ifdef USE_HDF5
+  HDF5Lock lock;
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
   hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
   CHECK_GE(data_hid, 0) << "Error reading weights from " << trained_filename;
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
   int num_layers = hdf5_get_num_links(data_hid);
   for (int i = 0; i < num_layers; ++i) {
     string source_layer_name = hdf5_get_name_by_idx(data_hid, i);
     if (!layer_names_index_.count(source_layer_name)) {
+      if (IsFoldedLayer(source_layer_name)) {
+        // Kept until all convolutions are copied, then folded into them.
+        hid_t layer_hid = H5Gopen2(data_hid, source_layer_name.c_str(),
+            H5P_DEFAULT);
+        CHECK_GE(layer_hid, 0)
+            << "Error reading weights from " << trained_filename;
+        vector<shared_ptr<Blob<Dtype> > >& blobs =
+            folded_blobs[source_layer_name];
+        int num_source_params = hdf5_get_num_links(layer_hid);
+        for (int j = 0; j < num_source_params; ++j) {
+          ostringstream oss;
+          oss << j;
+          blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          hdf5_load_nd_dataset(layer_hid, oss.str().c_str(), 0, kMaxBlobAxes,
+              blobs.back().get());
+        }
+        H5Gclose(layer_hid);
+        continue;
+      }
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
@@ -823,6 +1092,12 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string& trained_filename) {
         if (param_owners_[target_net_param_id] != -1) {
           // ...but it's weight-shared in target, so that's fine.
           continue;
+        } else if (j == 1 && folded_layers_.count(source_layer_name)) {
+          // ...but it's the bias of a fused convolution, which starts from
+          // zero.
+          caffe_set(target_blobs[j]->count(), static_cast<Dtype>(0),
+              target_blobs[j]->mutable_cpu_data());
+          continue;
         } else {
           LOG(FATAL) << "Incompatible number of blobs for layer "
               << source_layer_name;
@@ -833,6 +1108,7 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string& trained_filename) {
     }
     H5Gclose(layer_hid);
   }
+  FoldTrainedLayers(folded_blobs);
   H5Gclose(data_hid);
   H5Fclose(file_hid);
 #else
@@ -857,6 +1133,7 @@ template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 // This code is taken from https://github.com/sh1r0/caffe-android-lib
 #ifdef USE_HDF5
+  HDF5Lock lock;
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -918,13 +1195,49 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  if (Caffe::mode() == Caffe::CPU && flat_param_data_) {
+    caffe_axpy<Dtype>(flat_params_count_, Dtype(-1),
+        mutable_flat_param_diff(), mutable_flat_param_data());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
 }
 
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_flat_param_data() {
+  if (!flat_param_data_) {
+    return NULL;
+  }
+  // Also moves the head of each param to the CPU, as it is written through.
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    learnable_params_[i]->mutable_cpu_data();
+  }
+  CHECK(BlobsAreFlat(learnable_params_, false, flat_param_data_.get()))
+      << "A param was reshaped out of the flat params.";
+  return static_cast<Dtype*>(flat_param_data_->mutable_cpu_data());
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_flat_param_diff() {
+  if (!flat_param_diff_) {
+    return NULL;
+  }
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    learnable_params_[i]->mutable_cpu_diff();
+  }
+  CHECK(BlobsAreFlat(learnable_params_, true, flat_param_diff_.get()))
+      << "A param was reshaped out of the flat params.";
+  return static_cast<Dtype*>(flat_param_diff_->mutable_cpu_data());
+}
+
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  if (Caffe::mode() == Caffe::CPU && flat_param_diff_) {
+    caffe_set(flat_params_count_, Dtype(0), mutable_flat_param_diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
@@ -1,8 +1,27 @@
 #ifdef USE_NCCL
-
 #include <cuda_runtime.h>
+#endif
+#include <boost/bind.hpp>
+#include <errno.h>
+#include <fcntl.h>
 #include <glog/logging.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cstring>
+#include <ctime>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -10,6 +29,7 @@
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/benchmark.hpp"
 
 namespace caffe {
 
@@ -72,6 +92,8 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
     diff_() {
 }
 
+#ifdef USE_NCCL
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
   : Params<Dtype>(root_solver) {
@@ -361,11 +383,541 @@ void NCCL<Dtype>::Run(const vector<int>& gpus, const char* restore) {
   }
 }
 
-INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(Worker);
 INSTANTIATE_CLASS(NCCL);
 
-}  // namespace caffe
-
 #endif  // USE_NCCL
+
+template<typename Dtype>
+BucketScheduler<Dtype>::BucketScheduler(const Net<Dtype>& net, bool overlap,
+    size_t bucket_size, const ReduceFunction& reduce)
+  : overlap_(overlap),
+    size_(total_size<Dtype>(net.learnable_params())),
+    reduce_(reduce) {
+  ResetStats();
+  if (!overlap_) {
+    bucket_ranges_.push_back(make_pair(size_t(0), size_));
+    return;
+  }
+  CHECK_EQ(net.params().size(), net.learnable_params().size())
+    << "Layer-wise reduce is not supported for nets with shared weights.";
+  // Without shared weights, the params are in the order of their layers,
+  // so that the layers of a bucket, from the top down, cover a range.
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net.layers();
+  vector<size_t> offsets(layers.size() + 1, 0);
+  for (int i = 0; i < layers.size(); ++i) {
+    offsets[i + 1] = offsets[i];
+    for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+      offsets[i + 1] += layers[i]->blobs()[j]->count();
+    }
+  }
+  layer_buckets_.assign(layers.size(), -1);
+  size_t end = offsets[layers.size()];
+  for (int i = layers.size() - 1; i >= 0; --i) {
+    if (end > offsets[i] && (end - offsets[i] >= bucket_size || i == 0)) {
+      layer_buckets_[i] = bucket_ranges_.size();
+      bucket_ranges_.push_back(make_pair(offsets[i], end - offsets[i]));
+      end = offsets[i];
+    }
+  }
+  StartInternalThread();
+}
+
+template<typename Dtype>
+BucketScheduler<Dtype>::~BucketScheduler() {
+  StopInternalThread();
+}
+
+template<typename Dtype>
+void BucketScheduler<Dtype>::ResetStats() {
+  iterations_ = 0;
+  reduce_ms_ = 0;
+  exposed_ms_ = 0;
+}
+
+template<typename Dtype>
+void BucketScheduler<Dtype>::Reduce(size_t offset, size_t count) {
+  CPUTimer timer;
+  timer.Start();
+  reduce_(offset, count);
+  reduce_ms_ += timer.MilliSeconds();
+}
+
+template<typename Dtype>
+void BucketScheduler<Dtype>::run(int layer) {
+  CHECK(overlap_);
+  if (layer_buckets_[layer] >= 0) {
+    pending_.push(layer_buckets_[layer]);
+  }
+}
+
+template<typename Dtype>
+void BucketScheduler<Dtype>::Finish() {
+  CPUTimer timer;
+  timer.Start();
+  if (overlap_) {
+    pending_.push(-1);
+    done_.pop();
+  } else {
+    Reduce(bucket_ranges_[0].first, bucket_ranges_[0].second);
+  }
+  exposed_ms_ += timer.MilliSeconds();
+  ++iterations_;
+}
+
+template<typename Dtype>
+void BucketScheduler<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      const int bucket = pending_.pop();
+      if (bucket < 0) {
+        done_.push(bucket);
+      } else {
+        Reduce(bucket_ranges_[bucket].first, bucket_ranges_[bucket].second);
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template<typename Dtype>
+CPUAllreduce<Dtype>::CPUAllreduce(shared_ptr<Solver<Dtype> > solver)
+  : Params<Dtype>(solver),
+    solver_(solver),
+    rank_(Caffe::solver_rank()),
+    solver_count_(Caffe::solver_count()) {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU);
+  CHECK_EQ(solver->net()->flat_params_count(), 0)
+      << "The CPU allreduce places the params in its own buffers, which is "
+      << "not supported with flat_params.";
+}
+
+template<typename Dtype>
+CPUAllreduce<Dtype>::~CPUAllreduce() {
+}
+
+template<typename Dtype>
+void CPUAllreduce<Dtype>::Configure() {
+  const vector<Blob<Dtype>*>& net = solver_->net()->learnable_params();
+  apply_buffers(net, data_, size_, copy);
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
+template<typename Dtype>
+void CPUAllreduce<Dtype>::on_gradients_ready() {
+  scheduler_->Finish();
+  const int display = solver_->param().display();
+  if (display && solver_->iter() % display == 0) {
+    const int iterations = scheduler_->iterations();
+    LOG_IF(INFO, Caffe::root_solver()) << "Allreduce: "
+        << scheduler_->reduce_milliseconds() / iterations
+        << " ms per iteration in " << scheduler_->bucket_count()
+        << " buckets, " << scheduler_->exposed_milliseconds() / iterations
+        << " ms of it exposed";
+    scheduler_->ResetStats();
+  }
+}
+
+template<typename Dtype>
+void CPUAllreduce<Dtype>::Run() {
+  const SolverParameter& param = solver_->param();
+  // Later iterations of iter_size would write to gradients being reduced.
+  const bool overlap = param.layer_wise_reduce() && param.iter_size() == 1;
+  scheduler_.reset(new BucketScheduler<Dtype>(*solver_->net(), overlap,
+      param.reduce_bucket_size(),
+      boost::bind(&CPUAllreduce<Dtype>::Allreduce, this, _1, _2)));
+  solver_->add_callback(this);
+  if (overlap) {
+    solver_->net()->add_after_backward(scheduler_.get());
+  }
+  Broadcast();
+  if (rank_ == 0) {
+    solver_->Solve();
+  } else {
+    solver_->Step(param.max_iter() - solver_->iter());
+  }
+}
+
+// The barrier counters of the ranks are this many bytes apart, so that
+// ranks arriving do not invalidate the cache lines others are polling.
+static const size_t kCacheLineBytes = 128;
+// The slots of the ranks start at multiples of this many bytes.
+static const size_t kSlotAlignBytes = 64;
+// Polls of a barrier counter before yielding the CPU between polls.
+static const int kSpinsBeforeYield = 1 << 14;
+
+template<typename Dtype>
+ShmAllreduce<Dtype>::ShmAllreduce(shared_ptr<Solver<Dtype> > solver,
+                                  const string& name)
+  : CPUAllreduce<Dtype>(solver),
+    name_(name),
+    segment_(),
+    generation_(0) {
+  const size_t align = kSlotAlignBytes / sizeof(Dtype);
+  slot_size_ = (size_ + align - 1) / align * align;
+  const size_t header_bytes = solver_count_ * kCacheLineBytes;
+  segment_bytes_ = header_bytes + (solver_count_ + 1) * slot_size_
+      * sizeof(Dtype);
+
+  // The first rank to get here creates the segment and sizes it, which
+  // also zeroes the barrier counters.
+  int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0) {
+    CHECK_EQ(ftruncate(fd, segment_bytes_), 0)
+        << "Could not size " << name_ << ": " << strerror(errno);
+  } else {
+    CHECK_EQ(errno, EEXIST)
+        << "Could not create " << name_ << ": " << strerror(errno);
+    fd = shm_open(name_.c_str(), O_RDWR, 0600);
+    CHECK_GE(fd, 0) << "Could not open " << name_ << ": " << strerror(errno);
+    struct stat segment_stat;
+    do {
+      CHECK_EQ(fstat(fd, &segment_stat), 0);
+      sched_yield();
+    } while (segment_stat.st_size == 0);
+    CHECK_EQ(segment_stat.st_size, segment_bytes_)
+        << "The solvers have nets of different sizes.";
+  }
+  segment_ = mmap(NULL, segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+  CHECK(segment_ != MAP_FAILED)
+      << "Could not map " << name_ << ": " << strerror(errno);
+  close(fd);
+  arrived_ = static_cast<int64_t*>(segment_);
+  slots_ = reinterpret_cast<Dtype*>(static_cast<char*>(segment_)
+                                    + header_bytes);
+  result_ = slots_ + solver_count_ * slot_size_;
+  // Once every rank has mapped the segment, it no longer needs a name.
+  Barrier();
+  if (rank_ == 0) {
+    shm_unlink(name_.c_str());
+  }
+
+  // Move the params to the buffers, the gradients to the slot of this rank.
+  data_ = new Dtype[size_];
+  diff_ = slot(rank_);
+  this->Configure();
+}
+
+template<typename Dtype>
+ShmAllreduce<Dtype>::~ShmAllreduce() {
+  delete[] data_;
+  munmap(segment_, segment_bytes_);
+}
+
+template<typename Dtype>
+string ShmAllreduce<Dtype>::new_name() {
+  std::ostringstream name;
+  // Not from the Caffe RNG, which the forked processes would then share.
+  static int count = 0;
+  name << "/caffe_" << getpid() << "_" << time(NULL) << "_" << count++;
+  return name.str();
+}
+
+template<typename Dtype>
+vector<pid_t> ShmAllreduce<Dtype>::fork_solvers() {
+  const pid_t parent = getpid();
+  vector<pid_t> children;
+  for (int rank = 1; rank < Caffe::solver_count(); ++rank) {
+    const pid_t pid = fork();
+    CHECK_GE(pid, 0) << "Could not fork solver process " << rank;
+    if (pid == 0) {
+#ifdef __linux__
+      // Die with rank 0, which the allreduce would otherwise wait for
+      // forever. Rank 0 may have died before this was set.
+      CHECK_EQ(prctl(PR_SET_PDEATHSIG, SIGTERM), 0);
+      if (getppid() != parent) {
+        _exit(1);
+      }
+#endif
+      Caffe::set_solver_rank(rank);
+      // The generator state was copied from rank 0.
+      Caffe::set_random_seed(cluster_seedgen());
+      return vector<pid_t>();
+    }
+    children.push_back(pid);
+  }
+  return children;
+}
+
+template<typename Dtype>
+void ShmAllreduce<Dtype>::Barrier() {
+  ++generation_;
+  __atomic_store_n(&arrived_[rank_ * kCacheLineBytes / sizeof(int64_t)],
+                   generation_, __ATOMIC_RELEASE);
+  for (int rank = 0; rank < solver_count_; ++rank) {
+    const int64_t* arrived =
+        &arrived_[rank * kCacheLineBytes / sizeof(int64_t)];
+    for (int spin = 0; __atomic_load_n(arrived, __ATOMIC_ACQUIRE)
+         < generation_; ++spin) {
+      if (spin >= kSpinsBeforeYield) {
+        sched_yield();
+      }
+    }
+  }
+}
+
+template<typename Dtype>
+void ShmAllreduce<Dtype>::Allreduce(size_t offset, size_t count) {
+  // Wait for the range to be ready in every slot.
+  Barrier();
+  // Sum the share of this rank over the slots.
+  const size_t begin = offset + count * rank_ / solver_count_;
+  const int share = offset + count * (rank_ + 1) / solver_count_ - begin;
+  Dtype* sum = result_ + begin;
+  caffe_copy(share, slot(0) + begin, sum);
+  for (int rank = 1; rank < solver_count_; ++rank) {
+    caffe_axpy(share, Dtype(1), slot(rank) + begin, sum);
+  }
+  caffe_scal(share, Dtype(1) / solver_count_, sum);
+  // Wait for every share to be summed, then gather them.
+  Barrier();
+  caffe_copy(static_cast<int>(count), result_ + offset, diff_ + offset);
+}
+
+template<typename Dtype>
+void ShmAllreduce<Dtype>::Broadcast() {
+  if (rank_ == 0) {
+    caffe_copy(static_cast<int>(size_), data_, result_);
+  }
+  Barrier();
+  if (rank_ != 0) {
+    caffe_copy(static_cast<int>(size_), result_, data_);
+  }
+  Barrier();
+}
+
+// Attempts to connect to the next rank, 100ms apart, as it may start later.
+static const int kConnectAttempts = 3000;
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+// Splits a host:port endpoint.
+static void split_endpoint(const string& endpoint, string* host,
+                           string* port) {
+  const size_t colon = endpoint.rfind(':');
+  CHECK_NE(colon, string::npos) << "Expected host:port, got " << endpoint;
+  *host = endpoint.substr(0, colon);
+  *port = endpoint.substr(colon + 1);
+}
+
+static addrinfo* resolve(const string& endpoint, bool passive) {
+  string host, port;
+  split_endpoint(endpoint, &host, &port);
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));  // NOLINT(caffe/alt_fn)
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  addrinfo* info = NULL;
+  const int error = getaddrinfo(passive ? NULL : host.c_str(), port.c_str(),
+                                &hints, &info);
+  CHECK_EQ(error, 0) << "Could not resolve " << endpoint << ": "
+                     << gai_strerror(error);
+  return info;
+}
+
+// Makes a connected socket send small messages at once, without waiting.
+static void configure_socket(int fd) {
+  const int one = 1;
+  CHECK_EQ(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)), 0);
+  CHECK_GE(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK), 0);
+}
+
+template<typename Dtype>
+TcpAllreduce<Dtype>::TcpAllreduce(shared_ptr<Solver<Dtype> > solver,
+                                  const vector<string>& hosts)
+  : CPUAllreduce<Dtype>(solver),
+    send_fd_(-1),
+    recv_fd_(-1),
+    recv_buffer_(size_ / solver_count_ + 1) {
+  CHECK_EQ(hosts.size(), solver_count_)
+      << "Give the endpoint of each of the " << solver_count_ << " ranks.";
+  if (solver_count_ > 1) {
+    Connect(hosts);
+  }
+  data_ = new Dtype[size_];
+  diff_ = new Dtype[size_];
+  caffe_set(size_, Dtype(0), diff_);
+  this->Configure();
+}
+
+template<typename Dtype>
+TcpAllreduce<Dtype>::~TcpAllreduce() {
+  if (send_fd_ >= 0) {
+    close(send_fd_);
+  }
+  if (recv_fd_ >= 0) {
+    close(recv_fd_);
+  }
+  delete[] data_;
+  delete[] diff_;
+}
+
+template<typename Dtype>
+void TcpAllreduce<Dtype>::Connect(const vector<string>& hosts) {
+  // Listen before connecting, so that the ranks connecting to each other
+  // cannot all wait for the one behind them.
+  addrinfo* info = resolve(hosts[rank_], true);
+  const int listen_fd = socket(info->ai_family, info->ai_socktype,
+                               info->ai_protocol);
+  CHECK_GE(listen_fd, 0) << "Could not create socket: " << strerror(errno);
+  const int one = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  CHECK_EQ(bind(listen_fd, info->ai_addr, info->ai_addrlen), 0)
+      << "Could not listen on " << hosts[rank_] << ": " << strerror(errno);
+  CHECK_EQ(listen(listen_fd, 1), 0) << strerror(errno);
+  freeaddrinfo(info);
+
+  const int next = (rank_ + 1) % solver_count_;
+  info = resolve(hosts[next], false);
+  for (int attempt = 0; send_fd_ < 0; ++attempt) {
+    CHECK_LT(attempt, kConnectAttempts)
+        << "Could not connect to rank " << next << " at " << hosts[next];
+    send_fd_ = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    CHECK_GE(send_fd_, 0) << "Could not create socket: " << strerror(errno);
+    if (connect(send_fd_, info->ai_addr, info->ai_addrlen) != 0) {
+      close(send_fd_);
+      send_fd_ = -1;
+      boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    }
+  }
+  freeaddrinfo(info);
+  // Let the next rank check that the ring is set up as it expects.
+  const int32_t rank = rank_;
+  CHECK_EQ(send(send_fd_, &rank, sizeof(rank), kSendFlags), sizeof(rank));
+
+  recv_fd_ = accept(listen_fd, NULL, NULL);
+  CHECK_GE(recv_fd_, 0) << "Could not accept from rank "
+      << (rank_ + solver_count_ - 1) % solver_count_ << ": "
+      << strerror(errno);
+  close(listen_fd);
+  int32_t previous;
+  CHECK_EQ(recv(recv_fd_, &previous, sizeof(previous), MSG_WAITALL),
+           sizeof(previous));
+  CHECK_EQ(previous, (rank_ + solver_count_ - 1) % solver_count_)
+      << "The ranks were given different endpoints.";
+  configure_socket(send_fd_);
+  configure_socket(recv_fd_);
+  LOG_IF(INFO, Caffe::root_solver()) << "Connected " << solver_count_
+      << " ranks in a ring.";
+}
+
+template<typename Dtype>
+void TcpAllreduce<Dtype>::SendRecv(const void* send, size_t send_bytes,
+                                   void* recv, size_t recv_bytes) {
+  const char* send_ptr = static_cast<const char*>(send);
+  char* recv_ptr = static_cast<char*>(recv);
+  while (send_bytes > 0 || recv_bytes > 0) {
+    pollfd fds[2];
+    int count = 0;
+    if (send_bytes > 0) {
+      fds[count].fd = send_fd_;
+      fds[count++].events = POLLOUT;
+    }
+    if (recv_bytes > 0) {
+      fds[count].fd = recv_fd_;
+      fds[count++].events = POLLIN;
+    }
+    if (poll(fds, count, -1) < 0) {
+      CHECK_EQ(errno, EINTR) << "Could not poll: " << strerror(errno);
+      continue;
+    }
+    for (int i = 0; i < count; ++i) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      if (fds[i].fd == send_fd_) {
+        const ssize_t sent = ::send(send_fd_, send_ptr, send_bytes,
+                                    kSendFlags);
+        CHECK(sent >= 0 || errno == EAGAIN || errno == EINTR)
+            << "Could not send to the next rank: " << strerror(errno);
+        if (sent > 0) {
+          send_ptr += sent;
+          send_bytes -= sent;
+        }
+      } else {
+        const ssize_t received = ::recv(recv_fd_, recv_ptr, recv_bytes, 0);
+        CHECK_NE(received, 0) << "The previous rank disconnected.";
+        CHECK(received > 0 || errno == EAGAIN || errno == EINTR)
+            << "Could not receive from the previous rank: "
+            << strerror(errno);
+        if (received > 0) {
+          recv_ptr += received;
+          recv_bytes -= received;
+        }
+      }
+    }
+  }
+}
+
+template<typename Dtype>
+void TcpAllreduce<Dtype>::Allreduce(size_t offset, size_t count) {
+  if (solver_count_ == 1) {
+    return;
+  }
+  Dtype* data = diff_ + offset;
+  const int n = solver_count_;
+  // Chunk c of the range starts at chunk_begin[c].
+  vector<size_t> chunk_begin(n + 1);
+  for (int c = 0; c <= n; ++c) {
+    chunk_begin[c] = count * c / n;
+  }
+  // Reduce-scatter: rank r ends up with the sum of chunk (r + 1) % n.
+  for (int step = 0; step < n - 1; ++step) {
+    const int send_chunk = (rank_ - step + n) % n;
+    const int recv_chunk = (rank_ - step - 1 + n) % n;
+    const int recv_count = chunk_begin[recv_chunk + 1]
+        - chunk_begin[recv_chunk];
+    SendRecv(data + chunk_begin[send_chunk],
+             (chunk_begin[send_chunk + 1] - chunk_begin[send_chunk])
+             * sizeof(Dtype),
+             &recv_buffer_[0], recv_count * sizeof(Dtype));
+    caffe_axpy(recv_count, Dtype(1), &recv_buffer_[0],
+               data + chunk_begin[recv_chunk]);
+  }
+  const int own_chunk = (rank_ + 1) % n;
+  caffe_scal(static_cast<int>(chunk_begin[own_chunk + 1]
+                              - chunk_begin[own_chunk]),
+             Dtype(1) / n, data + chunk_begin[own_chunk]);
+  // Allgather: pass the averaged chunks on around the ring.
+  for (int step = 0; step < n - 1; ++step) {
+    const int send_chunk = (rank_ + 1 - step + n) % n;
+    const int recv_chunk = (rank_ - step + n) % n;
+    SendRecv(data + chunk_begin[send_chunk],
+             (chunk_begin[send_chunk + 1] - chunk_begin[send_chunk])
+             * sizeof(Dtype),
+             data + chunk_begin[recv_chunk],
+             (chunk_begin[recv_chunk + 1] - chunk_begin[recv_chunk])
+             * sizeof(Dtype));
+  }
+}
+
+template<typename Dtype>
+void TcpAllreduce<Dtype>::Broadcast() {
+  if (solver_count_ == 1) {
+    return;
+  }
+  // Pass the weights of rank 0 around the ring.
+  const size_t bytes = size_ * sizeof(Dtype);
+  if (rank_ != 0) {
+    SendRecv(NULL, 0, data_, bytes);
+  }
+  if (rank_ != solver_count_ - 1) {
+    SendRecv(data_, bytes, NULL, 0);
+  }
+}
+
+INSTANTIATE_CLASS(Params);
+INSTANTIATE_CLASS(BucketScheduler);
+INSTANTIATE_CLASS(CPUAllreduce);
+INSTANTIATE_CLASS(ShmAllreduce);
+INSTANTIATE_CLASS(TcpAllreduce);
+
+}  // namespace caffe
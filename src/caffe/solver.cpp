@@ -1,11 +1,13 @@
 #include <cstdio>
 
+#include <set>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/solver.hpp"
 #include "caffe/util/format.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/upgrade_proto.hpp"
@@ -464,6 +466,40 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
   net_->ToProto(&net_param, param_.snapshot_diff());
+  if (param_.snapshot_storage() != FLOAT32) {
+    // Only the params the solver learns are stored in the 16-bit type.
+    // Others, such as the BatchNorm statistics, may be out of its range.
+    std::set<const Blob<Dtype>*> learned;
+    const vector<Blob<Dtype>*>& learnable_params = net_->learnable_params();
+    for (int i = 0; i < learnable_params.size(); ++i) {
+      if (net_->params_lr()[i] != 0) {
+        learned.insert(learnable_params[i]);
+      }
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& params = net_->params();
+    for (int i = 0; i < params.size(); ++i) {
+      const int owner = net_->param_owners()[i];
+      if (owner >= 0 && learned.count(params[owner].get())) {
+        learned.insert(params[i].get());
+      }
+    }
+    const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+    for (int i = 0; i < net_param.layer_size(); ++i) {
+      LayerParameter* layer_param = net_param.mutable_layer(i);
+      for (int j = 0; j < layer_param->blobs_size(); ++j) {
+        if (!learned.count(layers[i]->blobs()[j].get())) {
+          continue;
+        }
+        if (!ConvertBlobProtoData(param_.snapshot_storage(),
+            layer_param->mutable_blobs(j))) {
+          LOG(WARNING) << "Keeping blob " << j << " of layer "
+              << layer_param->name() << " in FLOAT32, as its values are out "
+              << "of the range of "
+              << StorageType_Name(param_.snapshot_storage());
+        }
+      }
+    }
+  }
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
 }
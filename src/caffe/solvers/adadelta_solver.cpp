@@ -14,6 +14,7 @@ void AdaDeltaSolver<Dtype>::AdaDeltaPreSolve() {
         this->history_.push_back(
                 shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  this->FlattenHistory();
 }
 
 #ifndef CPU_ONLY
@@ -106,6 +107,37 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void adadelta_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h, Dtype* h2,
+    const RegularizedGradient<Dtype>& gradient, Dtype momentum, Dtype delta,
+    Dtype local_rate) {
+  CAFFE_PARALLEL_FOR_IF(N >= CAFFE_PARALLEL_MIN_COUNT)
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = gradient(g[i], w[i]);
+    const Dtype hi = h[i] = momentum * h[i] + (1 - momentum) * gi * gi;
+    gi = gi * std::sqrt((h2[i] + delta) / (hi + delta));
+    h2[i] = momentum * h2[i] + (1 - momentum) * gi * gi;
+    const Dtype update = local_rate * gi;
+    g[i] = update;
+    w[i] -= update;
+  }
+}
+
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ApplyFusedUpdate(int param_id, int end_id,
+    Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* param = net_params[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  size_t update_history_offset = net_params.size();
+  const int count = this->FusedCount(param_id, end_id);
+  adadelta_update_cpu(count, param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data(),
+      this->GetRegularizedGradient(param_id), Dtype(this->param_.momentum()),
+      Dtype(this->param_.delta()), local_rate);
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
@@ -14,6 +14,7 @@ void AdamSolver<Dtype>::AdamPreSolve() {
     this->history_.push_back(
             shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  this->FlattenHistory();
 }
 
 #ifndef CPU_ONLY
@@ -88,6 +89,41 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void adam_update_cpu(int N, Dtype* w, Dtype* g, Dtype* m, Dtype* v,
+    const RegularizedGradient<Dtype>& gradient, Dtype beta1, Dtype beta2,
+    Dtype eps_hat, Dtype corrected_local_rate) {
+  CAFFE_PARALLEL_FOR_IF(N >= CAFFE_PARALLEL_MIN_COUNT)
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = gradient(g[i], w[i]);
+    const Dtype mi = m[i] = m[i] * beta1 + gi * (1 - beta1);
+    const Dtype vi = v[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+    const Dtype update = corrected_local_rate * mi / (std::sqrt(vi) + eps_hat);
+    g[i] = update;
+    w[i] -= update;
+  }
+}
+
+template <typename Dtype>
+void AdamSolver<Dtype>::ApplyFusedUpdate(int param_id, int end_id,
+    Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  Blob<Dtype>* param = net_params[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  size_t update_history_offset = net_params.size();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  const int count = this->FusedCount(param_id, end_id);
+  adam_update_cpu(count, param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data(),
+      this->GetRegularizedGradient(param_id), beta1, beta2,
+      Dtype(this->param_.delta()), local_rate * correction);
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
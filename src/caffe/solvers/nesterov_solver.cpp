@@ -55,6 +55,34 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void nesterov_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const RegularizedGradient<Dtype>& gradient, Dtype momentum,
+    Dtype local_rate) {
+  CAFFE_PARALLEL_FOR_IF(N >= CAFFE_PARALLEL_MIN_COUNT)
+  for (int i = 0; i < N; ++i) {
+    const Dtype hi = h[i];
+    const Dtype hi_new = h[i] =
+        momentum * hi + local_rate * gradient(g[i], w[i]);
+    // step back then over step
+    const Dtype update = (1 + momentum) * hi_new - momentum * hi;
+    g[i] = update;
+    w[i] -= update;
+  }
+}
+
+template <typename Dtype>
+void NesterovSolver<Dtype>::ApplyFusedUpdate(int param_id, int end_id,
+    Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const int count = this->FusedCount(param_id, end_id);
+  nesterov_update_cpu(count, param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->GetRegularizedGradient(param_id), Dtype(this->param_.momentum()),
+      local_rate);
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -64,6 +64,32 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void rmsprop_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const RegularizedGradient<Dtype>& gradient, Dtype rms_decay, Dtype delta,
+    Dtype local_rate) {
+  CAFFE_PARALLEL_FOR_IF(N >= CAFFE_PARALLEL_MIN_COUNT)
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = gradient(g[i], w[i]);
+    const Dtype hi = h[i] = rms_decay * h[i] + (1 - rms_decay) * gi * gi;
+    const Dtype update = local_rate * gi / (std::sqrt(hi) + delta);
+    g[i] = update;
+    w[i] -= update;
+  }
+}
+
+template <typename Dtype>
+void RMSPropSolver<Dtype>::ApplyFusedUpdate(int param_id, int end_id,
+    Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const int count = this->FusedCount(param_id, end_id);
+  rmsprop_update_cpu(count, param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->GetRegularizedGradient(param_id), Dtype(this->param_.rms_decay()),
+      Dtype(this->param_.delta()), local_rate);
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
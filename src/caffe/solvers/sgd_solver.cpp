@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/flat_blobs.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/upgrade_proto.hpp"
@@ -82,6 +83,19 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  FlattenHistory();
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FlattenHistory() {
+  if (this->net_->flat_params_count() == 0) {
+    return;
+  }
+  vector<Blob<Dtype>*> history(history_.size());
+  for (int i = 0; i < history_.size(); ++i) {
+    history[i] = history_[i].get();
+  }
+  flat_history_ = FlattenBlobs(history, false);
 }
 
 template <typename Dtype>
@@ -89,9 +103,17 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const bool flat = Caffe::mode() == Caffe::CPU &&
+      this->net_->flat_params_count() > 0;
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+  if (flat) {
+    const int count = this->net_->flat_params_count();
+    const Dtype* diff = this->net_->mutable_flat_param_diff();
+    sumsq_diff = caffe_cpu_dot(count, diff, diff);
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -99,8 +121,13 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+    if (flat) {
+      caffe_scal<Dtype>(this->net_->flat_params_count(), scale_factor,
+          this->net_->mutable_flat_param_diff());
+    } else {
+      for (int i = 0; i < net_params.size(); ++i) {
+        net_params[i]->scale_diff(scale_factor);
+      }
     }
   }
 }
@@ -113,13 +140,24 @@ void SGDSolver<Dtype>::ApplyUpdate() {
         << ", lr = " << rate;
   }
   ClipGradients();
-  for (int param_id = 0; param_id < this->net_->learnable_params().size();
-       ++param_id) {
-    Normalize(param_id);
-    Regularize(param_id);
-    ComputeUpdateValue(param_id, rate);
+  const bool fused = Caffe::mode() == Caffe::CPU &&
+      this->param_.fused_update();
+  if (fused) {
+    for (int param_id = 0; param_id < this->net_->learnable_params().size();
+         ) {
+      const int end_id = FusedUpdateEnd(param_id);
+      ApplyFusedUpdate(param_id, end_id, rate);
+      param_id = end_id;
+    }
+  } else {
+    for (int param_id = 0; param_id < this->net_->learnable_params().size();
+         ++param_id) {
+      Normalize(param_id);
+      Regularize(param_id);
+      ComputeUpdateValue(param_id, rate);
+    }
+    this->net_->Update();
   }
-  this->net_->Update();
 
   // Increment the internal iter_ counter -- its value should always indicate
   // the number of times the weights have been updated.
@@ -214,6 +252,93 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   }
 }
 
+template <typename Dtype>
+RegularizedGradient<Dtype> SGDSolver<Dtype>::GetRegularizedGradient(
+    int param_id) {
+  const Dtype local_decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  const string& regularization_type = this->param_.regularization_type();
+  RegularizedGradient<Dtype> gradient;
+  gradient.scale = Dtype(1.) / this->param_.iter_size();
+  gradient.l2_decay = 0;
+  gradient.l1_decay = 0;
+  if (regularization_type == "L2") {
+    gradient.l2_decay = local_decay;
+  } else if (regularization_type == "L1") {
+    gradient.l1_decay = local_decay;
+  } else if (local_decay) {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+  return gradient;
+}
+
+template <typename Dtype>
+int SGDSolver<Dtype>::FusedUpdateEnd(int param_id) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_lr = this->net_->params_lr();
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  const int num_histories = history_.size() / net_params.size();
+  int end_id = param_id + 1;
+  for (; end_id < net_params.size(); ++end_id) {
+    const int last_id = end_id - 1;
+    if (net_params_lr[end_id] != net_params_lr[param_id] ||
+        net_params_weight_decay[end_id] != net_params_weight_decay[param_id]) {
+      break;
+    }
+    // The mutable accessors also move the heads of the params written
+    // through their neighbours to the CPU.
+    const int last_count = net_params[last_id]->count();
+    bool contiguous = net_params[end_id]->mutable_cpu_data() ==
+        net_params[last_id]->mutable_cpu_data() + last_count &&
+        net_params[end_id]->mutable_cpu_diff() ==
+        net_params[last_id]->mutable_cpu_diff() + last_count;
+    for (int h = 0; contiguous && h < num_histories; ++h) {
+      const int offset = h * net_params.size();
+      contiguous = history_[offset + end_id]->mutable_cpu_data() ==
+          history_[offset + last_id]->mutable_cpu_data() + last_count;
+    }
+    if (!contiguous) {
+      break;
+    }
+  }
+  return end_id;
+}
+
+template <typename Dtype>
+int SGDSolver<Dtype>::FusedCount(int param_id, int end_id) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  int count = 0;
+  for (int i = param_id; i < end_id; ++i) {
+    count += net_params[i]->count();
+  }
+  return count;
+}
+
+template <typename Dtype>
+void sgd_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const RegularizedGradient<Dtype>& gradient, Dtype momentum,
+    Dtype local_rate) {
+  CAFFE_PARALLEL_FOR_IF(N >= CAFFE_PARALLEL_MIN_COUNT)
+  for (int i = 0; i < N; ++i) {
+    const Dtype hi = h[i] = momentum * h[i] + local_rate * gradient(g[i], w[i]);
+    g[i] = hi;
+    w[i] -= hi;
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyFusedUpdate(int param_id, int end_id,
+    Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const int count = FusedCount(param_id, end_id);
+  sgd_update_cpu(count, param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), history_[param_id]->mutable_cpu_data(),
+      GetRegularizedGradient(param_id), Dtype(this->param_.momentum()),
+      local_rate);
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
@@ -294,6 +419,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   string snapshot_filename =
       Solver<Dtype>::SnapshotFilename(".solverstate.h5");
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
+  HDF5Lock lock;
   hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -342,6 +468,7 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
 template <typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
 #ifdef USE_HDF5
+  HDF5Lock lock;
   hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
   this->iter_ = hdf5_load_int(file_hid, "iter");
@@ -5,7 +5,8 @@
 namespace caffe {
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    version_(0), own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+    own_gpu_data_(false) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +16,8 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    version_(0), own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+    own_gpu_data_(false) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -104,6 +106,7 @@ void SyncedMemory::set_cpu_data(void* data) {
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
+  ++version_;
   own_cpu_data_ = false;
 }
 
@@ -127,6 +130,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   }
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
+  ++version_;
   own_gpu_data_ = false;
 #else
   NO_GPU;
@@ -137,6 +141,7 @@ void* SyncedMemory::mutable_cpu_data() {
   check_device();
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -145,6 +150,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
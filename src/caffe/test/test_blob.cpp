@@ -5,6 +5,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -112,6 +113,46 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestHalfProto) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  BlobProto blob_proto;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  ConvertBlobProtoData(BFLOAT16, &blob_proto);
+  EXPECT_EQ(0, blob_proto.data_size());
+  EXPECT_EQ(0, blob_proto.double_data_size());
+  EXPECT_EQ(2 * this->blob_preshaped_->count(),
+      blob_proto.half_data().size());
+  this->blob_->FromProto(blob_proto);
+  EXPECT_TRUE(this->blob_->ShapeEquals(blob_proto));
+  const TypeParam* data = this->blob_preshaped_->cpu_data();
+  const TypeParam* half_data = this->blob_->cpu_data();
+  for (int i = 0; i < this->blob_->count(); ++i) {
+    EXPECT_EQ(bf16_to_float(float_to_bf16(data[i])), half_data[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfProtoOutOfRange) {
+  TypeParam* data = this->blob_preshaped_->mutable_cpu_data();
+  caffe_set(this->blob_preshaped_->count(), TypeParam(1), data);
+  BlobProto blob_proto;
+  // Too large for FLOAT16, as a BatchNorm variance sum may be.
+  data[0] = 1e5;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  EXPECT_FALSE(ConvertBlobProtoData(FLOAT16, &blob_proto));
+  EXPECT_EQ(this->blob_preshaped_->count(), blob_proto.data_size());
+  EXPECT_FALSE(blob_proto.has_half_data());
+  EXPECT_TRUE(ConvertBlobProtoData(BFLOAT16, &blob_proto));
+  // Too small for FLOAT16.
+  data[0] = 1e-9;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  EXPECT_FALSE(ConvertBlobProtoData(FLOAT16, &blob_proto));
+  data[0] = 0;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  EXPECT_TRUE(ConvertBlobProtoData(FLOAT16, &blob_proto));
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
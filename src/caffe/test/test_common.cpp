@@ -42,6 +42,18 @@ TEST_F(CommonTest, TestRandSeedCPU) {
   }
 }
 
+TEST_F(CommonTest, TestNumThreads) {
+  Caffe::set_num_threads(2);
+#ifdef _OPENMP
+  EXPECT_EQ(2, Caffe::num_threads());
+#else
+  // Builds without OpenMP always report a single thread.
+  EXPECT_EQ(1, Caffe::num_threads());
+#endif
+  Caffe::set_num_threads(0);
+  EXPECT_GE(Caffe::num_threads(), 1);
+}
+
 #ifndef CPU_ONLY  // GPU Caffe singleton test.
 
 TEST_F(CommonTest, TestRandSeedGPU) {
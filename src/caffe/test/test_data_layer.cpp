@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -131,6 +132,48 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     Caffe::set_solver_rank(0);
   }
 
+  void TestShuffle() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    // Two epochs of rank 0's 3 items, or three of rank 1's 2.
+    int batch_size = 6;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    Caffe::set_random_seed(seed_);
+    Caffe::set_solver_count(2);
+    for (int rank = 0; rank < Caffe::solver_count(); ++rank) {
+      Caffe::set_solver_rank(rank);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      const int epoch_size = rank == 0 ? 3 : 2;
+      int num_sorted_epochs = 0;
+      for (int iter = 0; iter < 10; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int epoch = 0; epoch < batch_size / epoch_size; ++epoch) {
+          // Each epoch reads all of the rank's items, in some order.
+          const Dtype* label =
+              blob_top_label_->cpu_data() + epoch * epoch_size;
+          vector<int> labels(label, label + epoch_size);
+          bool sorted = true;
+          for (int i = 1; i < epoch_size; ++i) {
+            sorted &= labels[i - 1] < labels[i];
+          }
+          num_sorted_epochs += sorted;
+          std::sort(labels.begin(), labels.end());
+          for (int i = 0; i < epoch_size; ++i) {
+            EXPECT_EQ(rank + 2 * i, labels[i]);
+          }
+        }
+      }
+      EXPECT_LT(num_sorted_epochs, 10 * batch_size / epoch_size);
+    }
+    Caffe::set_solver_count(1);
+    Caffe::set_solver_rank(0);
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -362,6 +405,62 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // Get the crops and mirrors of two batches with decode_threads threads,
+  // and a cache of cache_size_mb, with Caffe seed 1701.
+  vector<Dtype> CropSequenceWithThreads(int decode_threads,
+      int cache_size_mb = 0) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads);
+    data_param->set_cache_size_mb(cache_size_mb);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(1);
+    transform_param->set_mirror(true);
+
+    Caffe::set_random_seed(seed_);
+    vector<Dtype> crop_sequence;
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+      }
+      crop_sequence.insert(crop_sequence.end(), blob_top_data_->cpu_data(),
+          blob_top_data_->cpu_data() + blob_top_data_->count());
+    }
+    return crop_sequence;
+  }
+
+  // Test that the crops do not depend on the number of decode threads.
+  void TestDecodeThreads() {
+    const vector<Dtype> crop_sequence = CropSequenceWithThreads(2);
+    EXPECT_EQ(20, crop_sequence.size());
+    const vector<Dtype> crop_sequence3 = CropSequenceWithThreads(3);
+    ASSERT_EQ(crop_sequence.size(), crop_sequence3.size());
+    for (int i = 0; i < crop_sequence.size(); ++i) {
+      EXPECT_EQ(crop_sequence[i], crop_sequence3[i]) << "debug: i " << i;
+    }
+  }
+
+  // Test that the second epoch, transformed from the cache, is transformed
+  // as it would have been from the db.
+  void TestCache() {
+    const vector<Dtype> crop_sequence = CropSequenceWithThreads(2);
+    EXPECT_EQ(20, crop_sequence.size());
+    const vector<Dtype> cached_sequence = CropSequenceWithThreads(2, 1);
+    ASSERT_EQ(crop_sequence.size(), cached_sequence.size());
+    for (int i = 0; i < crop_sequence.size(); ++i) {
+      EXPECT_EQ(crop_sequence[i], cached_sequence[i]) << "debug: i " << i;
+    }
+  }
+
   virtual ~DataLayerTest() { delete blob_top_data_; delete blob_top_label_; }
 
   DataParameter_DB backend_;
@@ -387,6 +486,11 @@ TYPED_TEST(DataLayerTest, TestSkipLevelDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestShuffleLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -418,6 +522,18 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
   this->TestReadCrop(TEST);
 }
+
+TYPED_TEST(DataLayerTest, TestDecodeThreadsLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestDecodeThreads();
+}
+
+TYPED_TEST(DataLayerTest, TestCacheLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestCache();
+}
 #endif  // USE_LEVELDB
 
 #ifdef USE_LMDB
@@ -432,6 +548,11 @@ TYPED_TEST(DataLayerTest, TestSkipLMDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestShuffleLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -464,6 +585,51 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   this->TestReadCrop(TEST);
 }
 
+TYPED_TEST(DataLayerTest, TestDecodeThreadsLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestDecodeThreads();
+}
+
+TYPED_TEST(DataLayerTest, TestCacheLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestCache();
+}
+
 #endif  // USE_LMDB
+
+TYPED_TEST(DataLayerTest, TestReadRecordIO) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_RECORDIO);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipRecordIO) {
+  this->Fill(false, DataParameter_DB_RECORDIO);
+  this->TestSkip();
+}
+
+TYPED_TEST(DataLayerTest, TestShuffleRecordIO) {
+  this->Fill(false, DataParameter_DB_RECORDIO);
+  this->TestShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestReshapeRecordIO) {
+  this->TestReshape(DataParameter_DB_RECORDIO);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededRecordIO) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_RECORDIO);
+  this->TestReadCropTrainSequenceSeeded();
+}
+
+TYPED_TEST(DataLayerTest, TestCacheRecordIO) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_RECORDIO);
+  this->TestCache();
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -9,6 +9,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -340,5 +341,61 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestCropMirrorMeanValuesSpeed) {
+  typedef TypeParam Dtype;
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int label = 0;
+  const int channels = 3;
+  const int height = 256;
+  const int width = 256;
+  const int crop_size = 227;
+  const Dtype scale = 0.5;
+  const Dtype mean_values[] = {104, 117, 123};
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(scale);
+  for (int c = 0; c < channels; ++c) {
+    transform_param.add_mean_value(mean_values[c]);
+  }
+  Datum datum;
+  FillDatum(label, channels, height, width, unique_pixels, &datum);
+  Blob<Dtype> blob(1, channels, crop_size, crop_size);
+  DataTransformer<Dtype> transformer(transform_param, TEST);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  const int num_iter = 100;
+  int num_mirrored = 0;
+  double transform_time = 0;
+  CPUTimer timer;
+  for (int iter = 0; iter < num_iter; ++iter) {
+    timer.Start();
+    transformer.Transform(datum, &blob);
+    transform_time += timer.MicroSeconds();
+    // The center crop of the datum, mirrored or not.
+    const int offset = (height - crop_size) / 2;
+    const bool mirrored = blob.cpu_data()[0] != (static_cast<Dtype>(
+        static_cast<uint8_t>(datum.data()[offset * width + offset]))
+        - mean_values[0]) * scale;
+    num_mirrored += mirrored;
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < crop_size; ++h) {
+        for (int w = 0; w < crop_size; ++w) {
+          const int data_w = offset + (mirrored ? crop_size - 1 - w : w);
+          const uint8_t pixel = static_cast<uint8_t>(
+              datum.data()[(c * height + offset + h) * width + data_w]);
+          ASSERT_EQ((static_cast<Dtype>(pixel) - mean_values[c]) * scale,
+              blob.cpu_data()[blob.offset(0, c, h, w)]);
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_mirrored, 0);
+  EXPECT_LT(num_mirrored, num_iter);
+  LOG(INFO) << "Transform time: " << transform_time / num_iter
+      << " us per datum of " << channels << "x" << height << "x" << width;
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -57,8 +57,13 @@ struct TypeLMDB {
 };
 DataParameter_DB TypeLMDB::backend = DataParameter_DB_LMDB;
 
+struct TypeRecordIO {
+  static DataParameter_DB backend;
+};
+DataParameter_DB TypeRecordIO::backend = DataParameter_DB_RECORDIO;
+
 // typedef ::testing::Types<TypeLmdb> TestTypes;
-typedef ::testing::Types<TypeLevelDB, TypeLMDB> TestTypes;
+typedef ::testing::Types<TypeLevelDB, TypeLMDB, TypeRecordIO> TestTypes;
 
 TYPED_TEST_CASE(DBTest, TestTypes);
 
@@ -117,6 +122,25 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueView) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  const string value = cursor->value();
+  const char* value_data = cursor->value_data();
+  EXPECT_EQ(value, string(value_data, cursor->value_size()));
+  Datum datum;
+  EXPECT_TRUE(datum.ParseFromArray(value_data, cursor->value_size()));
+  EXPECT_EQ(datum.height(), 360);
+  cursor->Next();
+  EXPECT_EQ(cursor->value(),
+      string(cursor->value_data(), cursor->value_size()));
+  if (cursor->stable_values()) {
+    // The view of the first value outlives the move.
+    EXPECT_EQ(value, string(value_data, value.size()));
+  }
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
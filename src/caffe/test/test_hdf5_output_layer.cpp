@@ -120,5 +120,67 @@ TYPED_TEST(HDF5OutputLayerTest, TestForward) {
       this->output_file_name_;
 }
 
+TYPED_TEST(HDF5OutputLayerTest, TestForwardAppend) {
+  typedef typename TypeParam::Dtype Dtype;
+  hid_t file_id = H5Fopen(this->input_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+      this->input_file_name_;
+  bool reshape = true;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4,
+                       this->blob_data_, reshape);
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4,
+                       this->blob_label_, reshape);
+  herr_t status = H5Fclose(file_id);
+  EXPECT_GE(status, 0)<< "Failed to close HDF5 file " <<
+      this->input_file_name_;
+  this->blob_bottom_vec_.push_back(this->blob_data_);
+  this->blob_bottom_vec_.push_back(this->blob_label_);
+
+  LayerParameter param;
+  HDF5OutputParameter* hdf5_output_param = param.mutable_hdf5_output_param();
+  hdf5_output_param->set_file_name(this->output_file_name_);
+  hdf5_output_param->set_append(true);
+  hdf5_output_param->set_chunk_rows(2);
+  hdf5_output_param->set_compression(1);
+  hdf5_output_param->set_write_buffers(2);
+  const int num_forward = 3;
+  // The layer writes what is left when it is deconstructed.
+  {
+    HDF5OutputLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < num_forward; ++i) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    }
+  }
+  file_id = H5Fopen(this->output_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0)<< "Failed to open HDF5 file" <<
+      this->output_file_name_;
+  Blob<Dtype> blob_data;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4,
+                       &blob_data, reshape);
+  Blob<Dtype> blob_label;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4,
+                       &blob_label, reshape);
+  status = H5Fclose(file_id);
+  EXPECT_GE(status, 0) << "Failed to close HDF5 file " <<
+      this->output_file_name_;
+
+  // Each Forward appended its rows.
+  ASSERT_EQ(num_forward * this->blob_data_->num(), blob_data.num());
+  ASSERT_EQ(num_forward * this->blob_label_->num(), blob_label.num());
+  EXPECT_EQ(this->blob_data_->count(1), blob_data.count(1));
+  EXPECT_EQ(this->blob_label_->count(1), blob_label.count(1));
+  for (int i = 0; i < blob_data.count(); ++i) {
+    EXPECT_EQ(this->blob_data_->cpu_data()[i % this->blob_data_->count()],
+        blob_data.cpu_data()[i]);
+  }
+  for (int i = 0; i < blob_label.count(); ++i) {
+    EXPECT_EQ(this->blob_label_->cpu_data()[i % this->blob_label_->count()],
+        blob_label.cpu_data()[i]);
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_HDF5
@@ -133,6 +133,48 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestReadChunks) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 4;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  // The files of 10 rows are streamed in chunks of 3, 3, 3 and 1 rows, which
+  // batches span.
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_prefetch(1);
+  Blob<Dtype> data;
+  Blob<Dtype> label;
+  vector<Blob<Dtype>*> top_vec;
+  top_vec.push_back(&data);
+  top_vec.push_back(&label);
+  HDF5DataLayer<Dtype> chunk_layer(param);
+  chunk_layer.SetUp(this->blob_bottom_vec_, top_vec);
+  EXPECT_EQ(this->blob_top_data_->shape(), data.shape());
+  EXPECT_EQ(this->blob_top_label_->shape(), label.shape());
+
+  // Go through both files twice.
+  for (int iter = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    chunk_layer.Forward(this->blob_bottom_vec_, top_vec);
+    for (int i = 0; i < label.count(); ++i) {
+      EXPECT_EQ(this->blob_top_label_->cpu_data()[i], label.cpu_data()[i])
+          << "debug: i " << i << " iter " << iter;
+    }
+    for (int i = 0; i < data.count(); ++i) {
+      EXPECT_EQ(this->blob_top_data_->cpu_data()[i], data.cpu_data()[i])
+          << "debug: i " << i << " iter " << iter;
+    }
+  }
+}
+
 TYPED_TEST(HDF5DataLayerTest, TestSkip) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_memory_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostMemoryPoolTest : public ::testing::Test {
+ protected:
+  HostMemoryPoolTest() : cache_limit_(HostMemoryPool::cache_limit()) {}
+  virtual ~HostMemoryPoolTest() {
+    HostMemoryPool::set_cache_limit(cache_limit_);
+  }
+
+  const size_t cache_limit_;
+};
+
+TEST_F(HostMemoryPoolTest, TestSizeClass) {
+  EXPECT_EQ(HostMemoryPool::SizeClass(0), 64);
+  EXPECT_EQ(HostMemoryPool::SizeClass(64), 64);
+  EXPECT_EQ(HostMemoryPool::SizeClass(65), 80);
+  EXPECT_EQ(HostMemoryPool::SizeClass(128), 128);
+  EXPECT_EQ(HostMemoryPool::SizeClass(129), 160);
+  for (size_t size = 1; size < 100000; size = size * 3 + 1) {
+    const size_t block_size = HostMemoryPool::SizeClass(size);
+    EXPECT_GE(block_size, size);
+    EXPECT_LE(block_size, std::max(size_t(64), size + size / 4));
+  }
+}
+
+TEST_F(HostMemoryPoolTest, TestAlignment) {
+  const size_t sizes[] = { 1, 10, 100, 1000, 10000 };
+  for (int i = 0; i < 5; ++i) {
+    void* ptr = HostMemoryPool::Allocate(sizes[i]);
+    EXPECT_EQ(reinterpret_cast<size_t>(ptr) % HostMemoryPool::kAlignment, 0);
+    memset(ptr, 1, sizes[i]);
+    HostMemoryPool::Free(ptr);
+  }
+}
+
+TEST_F(HostMemoryPoolTest, TestReuse) {
+  HostMemoryPool::set_cache_limit(size_t(1) << 30);
+  void* ptr = HostMemoryPool::Allocate(12345);
+  HostMemoryPool::Stats stats = HostMemoryPool::stats();
+  EXPECT_GE(stats.in_use, 12345);
+  EXPECT_GE(stats.peak_in_use, stats.in_use);
+  HostMemoryPool::Free(ptr);
+  EXPECT_EQ(HostMemoryPool::stats().in_use + HostMemoryPool::SizeClass(12345),
+      stats.in_use);
+  // A request of the same size class gets the same block back.
+  void* same_ptr = HostMemoryPool::Allocate(12300);
+  EXPECT_EQ(ptr, same_ptr);
+  EXPECT_EQ(HostMemoryPool::stats().hits, stats.hits + 1);
+  EXPECT_EQ(HostMemoryPool::stats().misses, stats.misses);
+  HostMemoryPool::Free(same_ptr);
+}
+
+TEST_F(HostMemoryPoolTest, TestCacheLimit) {
+  HostMemoryPool::set_cache_limit(0);
+  EXPECT_EQ(HostMemoryPool::stats().cached, 0);
+  void* ptr = HostMemoryPool::Allocate(1000);
+  HostMemoryPool::Free(ptr);
+  EXPECT_EQ(HostMemoryPool::stats().cached, 0);
+  const size_t misses = HostMemoryPool::stats().misses;
+  ptr = HostMemoryPool::Allocate(1000);
+  EXPECT_EQ(HostMemoryPool::stats().misses, misses + 1);
+  HostMemoryPool::Free(ptr);
+}
+
+TEST_F(HostMemoryPoolTest, TestSyncedMemory) {
+  HostMemoryPool::set_cache_limit(size_t(1) << 30);
+  const size_t in_use = HostMemoryPool::stats().in_use;
+  {
+    SyncedMemory mem(10000);
+    mem.mutable_cpu_data();
+    EXPECT_EQ(HostMemoryPool::stats().in_use,
+        in_use + HostMemoryPool::SizeClass(10000));
+  }
+  EXPECT_EQ(HostMemoryPool::stats().in_use, in_use);
+}
+
+}  // namespace caffe
@@ -125,6 +125,67 @@ TYPED_TEST(ImageDataLayerTest, TestResize) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestReadAhead) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_new_height(64);
+  image_data_param->set_new_width(64);
+  image_data_param->set_shuffle(false);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<Dtype> expected(this->blob_top_data_->cpu_data(),
+      this->blob_top_data_->cpu_data() + this->blob_top_data_->count());
+  // Files read ahead by a batch and a half, and decoded on two threads.
+  image_data_param->set_read_ahead(7);
+  param.mutable_data_param()->set_decode_threads(2);
+  Blob<Dtype> data;
+  Blob<Dtype> label;
+  vector<Blob<Dtype>*> top_vec;
+  top_vec.push_back(&data);
+  top_vec.push_back(&label);
+  ImageDataLayer<Dtype> read_ahead_layer(param);
+  read_ahead_layer.SetUp(this->blob_bottom_vec_, top_vec);
+  // Go through the data three times
+  for (int iter = 0; iter < 3; ++iter) {
+    read_ahead_layer.Forward(this->blob_bottom_vec_, top_vec);
+    ASSERT_EQ(expected.size(), data.count());
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, label.cpu_data()[i]);
+    }
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i], data.cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(ImageDataLayerTest, TestReducedDecode) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_new_height(60);
+  image_data_param->set_new_width(80);
+  image_data_param->set_reduced_decode(true);
+  image_data_param->set_shuffle(false);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 5);
+  EXPECT_EQ(this->blob_top_data_->channels(), 3);
+  EXPECT_EQ(this->blob_top_data_->height(), 60);
+  EXPECT_EQ(this->blob_top_data_->width(), 80);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->height(), 60);
+  EXPECT_EQ(this->blob_top_data_->width(), 80);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestReshape) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
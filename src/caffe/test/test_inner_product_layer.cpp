@@ -135,6 +135,87 @@ TYPED_TEST(InnerProductLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;  // int8 is CPU only.
+  }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  shared_ptr<InnerProductLayer<Dtype> > layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> float_top;
+  float_top.CopyFrom(*this->blob_top_, false, true);
+  // The bottom is uniform in [0, 1], as if calibrated to that range.
+  layer_param.mutable_quantization_param()->set_bottom_max(1);
+  shared_ptr<InnerProductLayer<Dtype> > int8_layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  int8_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Quantize the filled weights first, which the trained ones then replace.
+  int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    int8_layer->blobs()[i]->CopyFrom(*layer->blobs()[i]);
+  }
+  int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* data = this->blob_top_->cpu_data();
+  const Dtype* float_data = float_top.cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(data[i], float_data[i], 0.2);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;  // weight_storage is CPU only.
+  }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  const StorageType types[] = { FLOAT16, BFLOAT16 };
+  for (int t = 0; t < 2; ++t) {
+    for (int transpose = 0; transpose < 2; ++transpose) {
+      inner_product_param->set_transpose(transpose);
+      layer_param.clear_weight_storage();
+      shared_ptr<InnerProductLayer<Dtype> > layer(
+          new InnerProductLayer<Dtype>(layer_param));
+      layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      Blob<Dtype> float_top;
+      float_top.CopyFrom(*this->blob_top_, false, true);
+      layer_param.set_weight_storage(types[t]);
+      shared_ptr<InnerProductLayer<Dtype> > half_layer(
+          new InnerProductLayer<Dtype>(layer_param));
+      half_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      // Convert the filled weights first, which the trained ones replace.
+      half_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < layer->blobs().size(); ++i) {
+        half_layer->blobs()[i]->CopyFrom(*layer->blobs()[i]);
+      }
+      half_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      // The 60 weights of each output are rounded to 8 (bf16) or 11 (fp16)
+      // significant bits, and the bottom is in [0, 1].
+      const Dtype tolerance = types[t] == FLOAT16 ? 1e-2 : 1e-1;
+      const Dtype* data = this->blob_top_->cpu_data();
+      const Dtype* float_data = float_top.cpu_data();
+      for (int i = 0; i < this->blob_top_->count(); ++i) {
+        EXPECT_NEAR(data[i], float_data[i], tolerance);
+      }
+    }
+  }
+}
+
 /**
  * @brief Init. an IP layer without transpose + random weights,
  * run Forward, save the result.
@@ -7,6 +7,8 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/layer_factory.hpp"
+#include "caffe/layers/depthwise_conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
 
@@ -48,4 +50,34 @@ TYPED_TEST(LayerFactoryTest, TestCreateLayer) {
   }
 }
 
+#ifndef USE_CUDNN
+TYPED_TEST(LayerFactoryTest, TestConvolutionDefaultEngine) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->set_num_output(8);
+  conv_param->add_kernel_size(3);
+  shared_ptr<Layer<Dtype> > layer =
+      LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_FALSE(dynamic_cast<WinogradConvolutionLayer<Dtype>*>(layer.get()));
+  conv_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  layer = LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_TRUE(dynamic_cast<WinogradConvolutionLayer<Dtype>*>(layer.get()));
+  conv_param->set_engine(ConvolutionParameter_Engine_DEFAULT);
+  conv_param->set_group(8);
+  layer = LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_FALSE(dynamic_cast<DepthwiseConvolutionLayer<Dtype>*>(layer.get()));
+  conv_param->set_engine(ConvolutionParameter_Engine_DEPTHWISE);
+  layer = LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_TRUE(dynamic_cast<DepthwiseConvolutionLayer<Dtype>*>(layer.get()));
+  conv_param->set_engine(ConvolutionParameter_Engine_DEFAULT);
+  conv_param->set_group(1);
+  conv_param->add_stride(2);
+  layer = LayerRegistry<Dtype>::CreateLayer(layer_param);
+  EXPECT_FALSE(dynamic_cast<WinogradConvolutionLayer<Dtype>*>(layer.get()));
+  EXPECT_FALSE(dynamic_cast<DepthwiseConvolutionLayer<Dtype>*>(layer.get()));
+}
+#endif  // !USE_CUDNN
+
 }  // namespace caffe
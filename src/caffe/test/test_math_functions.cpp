@@ -1,12 +1,15 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -119,6 +122,121 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestQuantizeInt8) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  const TypeParam scale = caffe_cpu_amax<TypeParam>(n, x) / 127;
+  vector<int8_t> y(n);
+  caffe_cpu_quantize_int8<TypeParam>(n, scale, x, &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_LE(std::fabs(y[i] * scale - x[i]), scale * TypeParam(0.501));
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmInt8) {
+  // The second shape spans several column blocks with a partial last one.
+  const int shapes[][3] = { {5, 6, 7}, {3, 301, 19} };
+  for (int s = 0; s < 2; ++s) {
+    const int M = shapes[s][0], N = shapes[s][1], K = shapes[s][2];
+    vector<int8_t> A(M * K), B(K * N), B_trans(N * K);
+    for (int i = 0; i < M * K; ++i) {
+      A[i] = static_cast<int>(caffe_rng_rand() % 255) - 127;
+    }
+    for (int k = 0; k < K; ++k) {
+      for (int j = 0; j < N; ++j) {
+        B[k * N + j] = static_cast<int>(caffe_rng_rand() % 255) - 127;
+        B_trans[j * K + k] = B[k * N + j];
+      }
+    }
+    vector<int32_t> C(M * N), C_trans(M * N);
+    caffe_cpu_gemm_int8(CblasNoTrans, M, N, K, &A[0], &B[0], &C[0]);
+    caffe_cpu_gemm_int8(CblasTrans, M, N, K, &A[0], &B_trans[0],
+        &C_trans[0]);
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < N; ++j) {
+        int32_t expected = 0;
+        for (int k = 0; k < K; ++k) {
+          expected += A[i * K + k] * B[k * N + j];
+        }
+        EXPECT_EQ(expected, C[i * N + j]);
+        EXPECT_EQ(expected, C_trans[i * N + j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestHalfSpecialValues) {
+  EXPECT_EQ(0x3c00, float_to_fp16(1));
+  EXPECT_EQ(0xc000, float_to_fp16(-2));
+  EXPECT_EQ(0x7bff, float_to_fp16(65504));
+  EXPECT_EQ(0x7c00, float_to_fp16(65520));  // rounds up to infinity
+  EXPECT_EQ(0x0001, float_to_fp16(std::ldexp(1.f, -24)));
+  EXPECT_EQ(0x0000, float_to_fp16(std::ldexp(1.f, -26)));
+  EXPECT_EQ(0x3c00, float_to_fp16(1 + std::ldexp(1.f, -11)));  // tie to even
+  EXPECT_EQ(std::ldexp(1.f, -24), fp16_to_float(0x0001));
+  EXPECT_EQ(-65504, fp16_to_float(0xfbff));
+  EXPECT_TRUE(std::isinf(fp16_to_float(0x7c00)));
+  EXPECT_TRUE(std::isnan(fp16_to_float(float_to_fp16(NAN))));
+  EXPECT_EQ(0x3f80, float_to_bf16(1));
+  EXPECT_EQ(0x3f80, float_to_bf16(1 + std::ldexp(1.f, -8)));  // tie to even
+  EXPECT_EQ(0x3f81, float_to_bf16(1 + std::ldexp(1.f, -8) +
+      std::ldexp(1.f, -12)));
+  EXPECT_EQ(-3, bf16_to_float(0xc040));
+  EXPECT_TRUE(std::isnan(bf16_to_float(float_to_bf16(NAN))));
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestHalfRoundTrip) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  vector<uint16_t> half(n);
+  vector<TypeParam> y(n);
+  // Rounding to nearest loses at most half a unit in the last place.
+  caffe_cpu_to_half<TypeParam>(n, x, FLOAT16, &half[0]);
+  caffe_cpu_from_half<TypeParam>(n, &half[0], FLOAT16, &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_LE(std::fabs(y[i] - x[i]),
+        std::max(std::fabs(x[i]) * std::ldexp(1., -11), std::ldexp(1., -25)));
+  }
+  caffe_cpu_to_half<TypeParam>(n, x, BFLOAT16, &half[0]);
+  caffe_cpu_from_half<TypeParam>(n, &half[0], BFLOAT16, &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_LE(std::fabs(y[i] - x[i]), std::fabs(x[i]) * std::ldexp(1., -8));
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestHalfGemm) {
+  // Enough rows of A for several blocks to be converted, for a product split
+  // over the rows and one left to the BLAS gemm.
+  const int M = 70, K = 1000;
+  const int widths[] = { 3, 40 };
+  for (int w = 0; w < 2; ++w) {
+    const int N = widths[w];
+    vector<TypeParam> A(M * K), B(K * N), B_trans(N * K);
+    caffe_rng_gaussian<TypeParam>(M * K, 0, 1, &A[0]);
+    caffe_rng_gaussian<TypeParam>(K * N, 0, 1, &B[0]);
+    for (int k = 0; k < K; ++k) {
+      for (int j = 0; j < N; ++j) {
+        B_trans[j * K + k] = B[k * N + j];
+      }
+    }
+    vector<uint16_t> A_half(M * K);
+    caffe_cpu_to_half<TypeParam>(M * K, &A[0], BFLOAT16, &A_half[0]);
+    // The product has to match the float product of the rounded A.
+    caffe_cpu_from_half<TypeParam>(M * K, &A_half[0], BFLOAT16, &A[0]);
+    vector<TypeParam> C(M * N), C_half(M * N), C_trans(M * N);
+    caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1, &A[0],
+        &B[0], 0, &C[0]);
+    caffe_cpu_half_gemm<TypeParam>(CblasNoTrans, M, N, K, &A_half[0],
+        BFLOAT16, &B[0], &C_half[0]);
+    caffe_cpu_half_gemm<TypeParam>(CblasTrans, M, N, K, &A_half[0], BFLOAT16,
+        &B_trans[0], &C_trans[0]);
+    for (int i = 0; i < M * N; ++i) {
+      EXPECT_NEAR(C[i], C_half[i], 1e-3);
+      EXPECT_NEAR(C[i], C_trans[i], 1e-3);
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
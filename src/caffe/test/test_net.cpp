@@ -8,9 +8,11 @@
 
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/net.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/plan_in_place.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -564,8 +566,8 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
-  virtual void InitReshapableNet() {
-    const string& proto =
+  virtual void InitReshapableNet(const bool optimize_memory = false) {
+    string proto =
         "name: 'ReshapableNetwork' "
         "layer { "
         "  name: 'data' "
@@ -626,6 +628,9 @@ class NetTest : public MultiDeviceTest<TypeParam> {
         "  bottom: 'norm1' "
         "  top: 'softmax' "
         "} ";
+    if (optimize_memory) {
+      proto += "state { phase: TEST } optimize_memory: true ";
+    }
     InitNetFromProtoString(proto);
   }
 
@@ -2374,6 +2379,226 @@ TEST_F(FilterNetTest, TestFilterInOutByExcludeMultiRule) {
   this->RunFilterNetTest(input_proto_test, output_proto_test);
 }
 
+class PlanInPlaceTest : public ::testing::Test {
+ protected:
+  void RunPlanInPlaceTest(
+      const string& input_param_string, const string& planned_param_string) {
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_planned_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        planned_param_string, &expected_planned_param));
+    NetParameter actual_planned_param;
+    PlanInPlace(input_param, &actual_planned_param);
+    EXPECT_EQ(expected_planned_param.DebugString(),
+        actual_planned_param.DebugString());
+    // Also test idempotence.
+    NetParameter double_planned_param;
+    PlanInPlace(actual_planned_param, &double_planned_param);
+    EXPECT_EQ(actual_planned_param.DebugString(),
+       double_planned_param.DebugString());
+  }
+};
+
+TEST_F(PlanInPlaceTest, TestSingleConsumers) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "state: { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'relu0' "
+      "  type: 'ReLU' "
+      "  bottom: 'data' "
+      "  top: 'relu0' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'relu0' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv1' "
+      "  top: 'bn1' "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'bn1' "
+      "  top: 'relu1' "
+      "} "
+      "layer { "
+      "  name: 'pool1' "
+      "  type: 'Pooling' "
+      "  bottom: 'relu1' "
+      "  top: 'pool1' "
+      "} "
+      "layer { "
+      "  name: 'sigmoid1' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'relu1' "
+      "  top: 'sigmoid1' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "state: { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'relu0' "
+      "  type: 'ReLU' "
+      "  bottom: 'data' "
+      "  top: 'relu0' "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'relu0' "
+      "  top: 'relu1' "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'relu1' "
+      "  top: 'relu1' "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'relu1' "
+      "  top: 'relu1' "
+      "} "
+      "layer { "
+      "  name: 'pool1' "
+      "  type: 'Pooling' "
+      "  bottom: 'relu1' "
+      "  top: 'pool1' "
+      "} "
+      "layer { "
+      "  name: 'sigmoid1' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'relu1' "
+      "  top: 'sigmoid1' "
+      "} ";
+  this->RunPlanInPlaceTest(input_proto, expected_output_proto);
+}
+
+TEST_F(PlanInPlaceTest, TestTrainPhase) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'innerprod' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'innerprod' "
+      "} "
+      "layer { "
+      "  name: 'sigmoid' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'innerprod' "
+      "  top: 'sigmoid' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'sigmoid' "
+      "  top: 'relu' "
+      "} "
+      "layer { "
+      "  name: 'power' "
+      "  type: 'Power' "
+      "  bottom: 'relu' "
+      "  top: 'power' "
+      "} ";
+  const string& input_proto_train =
+      "state: { phase: TRAIN } " + input_proto;
+  const string& input_proto_test =
+      "state: { phase: TEST } " + input_proto;
+  // The Sigmoid's Backward needs its top data, and Power only runs in-place
+  // in TEST phase.
+  const string& output_proto_train =
+      "state: { phase: TRAIN } "
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'innerprod' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'sigmoid' "
+      "} "
+      "layer { "
+      "  name: 'sigmoid' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'sigmoid' "
+      "  top: 'sigmoid' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'sigmoid' "
+      "  top: 'relu' "
+      "} "
+      "layer { "
+      "  name: 'power' "
+      "  type: 'Power' "
+      "  bottom: 'relu' "
+      "  top: 'power' "
+      "} ";
+  const string& output_proto_test =
+      "state: { phase: TEST } "
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'innerprod' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'power' "
+      "} "
+      "layer { "
+      "  name: 'sigmoid' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'power' "
+      "  top: 'power' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'power' "
+      "  top: 'power' "
+      "} "
+      "layer { "
+      "  name: 'power' "
+      "  type: 'Power' "
+      "  bottom: 'power' "
+      "  top: 'power' "
+      "} ";
+  this->RunPlanInPlaceTest(input_proto_train, output_proto_train);
+  this->RunPlanInPlaceTest(input_proto_test, output_proto_test);
+}
+
 TYPED_TEST(NetTest, TestReshape) {
   typedef typename TypeParam::Dtype Dtype;
   // We set up bottom blobs of two different sizes, switch between
@@ -2446,6 +2671,400 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestOptimizeMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> blob1(2, 3, 12, 10);
+  Blob<Dtype> blob2(4, 3, 15, 11);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+  Caffe::set_random_seed(this->seed_);
+  this->InitReshapableNet();
+  shared_ptr<Net<Dtype> > net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitReshapableNet(true);
+  shared_ptr<Net<Dtype> > optimized_net = this->net_;
+  // conv1 is dead by the time norm1 is computed, so they share storage.
+  EXPECT_EQ(optimized_net->blob_by_name("conv1")->data().get(),
+      optimized_net->blob_by_name("norm1")->data().get());
+  EXPECT_NE(net->blob_by_name("conv1")->data().get(),
+      net->blob_by_name("norm1")->data().get());
+  // The outputs match those of the unoptimized net, also after reshaping.
+  Blob<Dtype>* blobs[] = { &blob1, &blob2 };
+  for (int b = 0; b < 2; ++b) {
+    shared_ptr<Net<Dtype> > nets[] = { net, optimized_net };
+    for (int n = 0; n < 2; ++n) {
+      Blob<Dtype>* input_blob = nets[n]->blob_by_name("data").get();
+      input_blob->ReshapeLike(*blobs[b]);
+      caffe_copy(blobs[b]->count(), blobs[b]->cpu_data(),
+          input_blob->mutable_cpu_data());
+      nets[n]->Reshape();
+      nets[n]->Forward();
+    }
+    const Blob<Dtype>* output = net->output_blobs()[0];
+    const Blob<Dtype>* optimized_output = optimized_net->output_blobs()[0];
+    ASSERT_EQ(output->count(), optimized_output->count());
+    for (int i = 0; i < output->count(); ++i) {
+      EXPECT_FLOAT_EQ(output->cpu_data()[i], optimized_output->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestOptimizeMemoryLossWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The loss weight of 'loss' lives in its diff, and 'loss' is also consumed
+  // by a later layer, so it must keep its diff when storage is shared.
+  const string& proto =
+      "name: 'LossNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'target' "
+      "  input_param { "
+      "    shape: { dim: 4 dim: 6 } "
+      "    shape: { dim: 4 dim: 3 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'ip1' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'ip1' "
+      "  top: 'ip2' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'ip2' "
+      "  bottom: 'target' "
+      "  top: 'loss' "
+      "  loss_weight: 2 "
+      "} "
+      "layer { "
+      "  name: 'scaled' "
+      "  type: 'Power' "
+      "  bottom: 'loss' "
+      "  top: 'scaled' "
+      "  power_param { scale: 3 } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  param.mutable_state()->set_phase(TEST);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Dtype loss[2];
+  for (int n = 0; n < 2; ++n) {
+    param.set_optimize_memory(n == 1);
+    Caffe::set_random_seed(this->seed_);
+    Net<Dtype> net(param);
+    filler.Fill(net.blob_by_name("data").get());
+    filler.Fill(net.blob_by_name("target").get());
+    net.Forward(&loss[n]);
+  }
+  EXPECT_NE(loss[0], Dtype(0));
+  EXPECT_FLOAT_EQ(loss[0], loss[1]);
+}
+
+TYPED_TEST(NetTest, TestSharedConvolutionWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Convolution layers of different sizes borrow the same column buffer from
+  // the net; check each of them against a layer that owns its buffer.
+  const string& proto =
+      "name: 'WorkspaceNetwork' "
+      "force_backward: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 2 dim: 3 dim: 9 dim: 8 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 6 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'deconv' "
+      "  type: 'Deconvolution' "
+      "  bottom: 'conv1' "
+      "  top: 'deconv' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 4 "
+      "    stride: 2 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  bottom: 'deconv' "
+      "  top: 'conv2' "
+      "  convolution_param { "
+      "    num_output: 3 "
+      "    kernel_size: 5 "
+      "    stride: 2 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->blob_by_name("data").get());
+  this->net_->Forward();
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  Blob<Dtype> output_diff;
+  output_diff.ReshapeLike(*output_blob);
+  filler.Fill(&output_diff);
+  caffe_copy(output_diff.count(), output_diff.cpu_data(),
+      output_blob->mutable_cpu_diff());
+  this->net_->Backward();
+  for (int layer_id = 1; layer_id < this->net_->layers().size(); ++layer_id) {
+    Layer<Dtype>* net_layer = this->net_->layers()[layer_id].get();
+    Blob<Dtype>* net_bottom = this->net_->bottom_vecs()[layer_id][0];
+    Blob<Dtype>* net_top = this->net_->top_vecs()[layer_id][0];
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(net_layer->layer_param());
+    Blob<Dtype> bottom, top;
+    bottom.CopyFrom(*net_bottom, false, true);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<Blob<Dtype>*> top_vec(1, &top);
+    layer->SetUp(bottom_vec, top_vec);
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      layer->blobs()[i]->ShareData(*net_layer->blobs()[i]);
+    }
+    layer->Forward(bottom_vec, top_vec);
+    ASSERT_EQ(net_top->count(), top.count());
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_FLOAT_EQ(net_top->cpu_data()[i], top.cpu_data()[i]);
+    }
+    top.CopyFrom(*net_top, true, false);
+    layer->Backward(top_vec, vector<bool>(1, true), bottom_vec);
+    for (int i = 0; i < bottom.count(); ++i) {
+      EXPECT_FLOAT_EQ(net_bottom->cpu_diff()[i], bottom.cpu_diff()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'FusionNetwork' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 2 dim: 3 dim: 6 dim: 5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    bias_term: false "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'scale1' "
+      "  type: 'Scale' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "  scale_param { bias_term: true } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "  relu_param { negative_slope: 0.1 } "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  bottom: 'conv1' "
+      "  top: 'conv2' "
+      "  convolution_param { "
+      "    num_output: 5 "
+      "    kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn2' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv2' "
+      "  top: 'bn2' "
+      "} "
+      "layer { "
+      "  name: 'relu2' "
+      "  type: 'ReLU' "
+      "  bottom: 'bn2' "
+      "  top: 'relu2' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  // Give the BatchNorm and Scale layers trained-looking blobs.
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> gaussian_filler(filler_param);
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> variance_filler(filler_param);
+  const char* bn_names[] = { "bn1", "bn2" };
+  for (int i = 0; i < 2; ++i) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        net.layer_by_name(bn_names[i])->blobs();
+    gaussian_filler.Fill(blobs[0].get());
+    variance_filler.Fill(blobs[1].get());
+    blobs[2]->mutable_cpu_data()[0] = 2;
+  }
+  const vector<shared_ptr<Blob<Dtype> > >& scale_blobs =
+      net.layer_by_name("scale1")->blobs();
+  gaussian_filler.Fill(scale_blobs[0].get());
+  gaussian_filler.Fill(scale_blobs[1].get());
+  NetParameter weights;
+  net.ToProto(&weights);
+  // Fuse everything into the two convolutions.
+  param.set_fuse_layers(true);
+  Net<Dtype> fused_net(param);
+  fused_net.CopyTrainedLayersFrom(weights);
+  ASSERT_EQ(fused_net.layers().size(), 3);
+  EXPECT_EQ(fused_net.layer_names()[1], "conv1");
+  EXPECT_EQ(fused_net.layer_names()[2], "conv2");
+  EXPECT_TRUE(fused_net.has_blob("relu2"));
+  EXPECT_FALSE(fused_net.has_blob("bn2"));
+  // The outputs match those of the unfused net.
+  gaussian_filler.Fill(net.input_blobs()[0]);
+  fused_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+  net.Forward();
+  fused_net.Forward();
+  const Blob<Dtype>* output = net.output_blobs()[0];
+  const Blob<Dtype>* fused_output = fused_net.output_blobs()[0];
+  ASSERT_EQ(output->count(), fused_output->count());
+  for (int i = 0; i < output->count(); ++i) {
+    EXPECT_NEAR(output->cpu_data()[i], fused_output->cpu_data()[i], 1e-4);
+  }
+  // Sharing the unfused net's layers folds them again each time, as a solver
+  // does before each test, and leaves the unfused net's weights alone.
+  Net<Dtype> shared_net(param);
+  for (int n = 0; n < 2; ++n) {
+    shared_net.ShareTrainedLayersWith(&net);
+    shared_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+    net.Forward();
+    shared_net.Forward();
+    const Blob<Dtype>* shared_output = shared_net.output_blobs()[0];
+    for (int i = 0; i < output->count(); ++i) {
+      EXPECT_NEAR(output->cpu_data()[i], shared_output->cpu_data()[i], 1e-4);
+      EXPECT_NEAR(fused_output->cpu_data()[i], shared_output->cpu_data()[i],
+          1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseLayersSharedParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Folding bn1 would rewrite the weights conv2 shares, so it stays; the
+  // ReLU does not touch the weights and is still fused.
+  const string& proto =
+      "name: 'SharedFusionNetwork' "
+      "state { phase: TEST } "
+      "fuse_layers: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "  shape: { dim: 2 dim: 3 dim: 6 dim: 5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  param { name: 'shared_weights' } "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    bias_term: false "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv1' "
+      "  top: 'bn1' "
+      "} "
+      "layer { "
+      "  name: 'conv2' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv2' "
+      "  param { name: 'shared_weights' } "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    bias_term: false "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu2' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv2' "
+      "  top: 'relu2' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  EXPECT_TRUE(this->net_->has_layer("bn1"));
+  EXPECT_FALSE(this->net_->has_layer("relu2"));
+  EXPECT_TRUE(this->net_->has_blob("relu2"));
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
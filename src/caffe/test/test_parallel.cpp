@@ -0,0 +1,420 @@
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/layers/dropout_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/sgd_solvers.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+using std::ostringstream;
+
+namespace caffe {
+
+// A least squares net of two layers with params, on random data.
+static const char* kNetProto =
+    "name: 'TestNetwork' "
+    "layer { "
+    "  name: 'data' "
+    "  type: 'DummyData' "
+    "  dummy_data_param { "
+    "    shape { dim: 4 dim: 3 } "
+    "    shape { dim: 4 dim: 1 } "
+    "    data_filler { type: 'gaussian' } "
+    "  } "
+    "  top: 'data' "
+    "  top: 'targets' "
+    "} "
+    "layer { "
+    "  name: 'innerprod' "
+    "  type: 'InnerProduct' "
+    "  inner_product_param { "
+    "    num_output: 2 "
+    "    weight_filler { type: 'gaussian' } "
+    "    bias_filler { type: 'gaussian' } "
+    "  } "
+    "  bottom: 'data' "
+    "  top: 'innerprod' "
+    "} "
+    "layer { "
+    "  name: 'innerprod2' "
+    "  type: 'InnerProduct' "
+    "  inner_product_param { "
+    "    num_output: 1 "
+    "    weight_filler { type: 'gaussian' } "
+    "    bias_filler { type: 'gaussian' } "
+    "  } "
+    "  bottom: 'innerprod' "
+    "  top: 'innerprod2' "
+    "} "
+    "layer { "
+    "  name: 'loss' "
+    "  type: 'EuclideanLoss' "
+    "  bottom: 'innerprod2' "
+    "  bottom: 'targets' "
+      "}";
+
+// Exposes the reduction of an Allreduce to the tests.
+template <typename Dtype, typename Allreduce>
+class KnownValuesAllreduce : public Allreduce {
+ public:
+  template <typename Config>
+  KnownValuesAllreduce(shared_ptr<Solver<Dtype> > solver,
+      const Config& config)
+      : Allreduce(solver, config) {
+  }
+
+  // Sets gradient i of rank r to 100 * r + i, reduces the range
+  // [offset, offset + count) of them and returns all of the gradients.
+  vector<Dtype> Reduce(size_t offset, size_t count) {
+    for (size_t i = 0; i < this->size_; ++i) {
+      this->diff_[i] = 100 * Caffe::solver_rank() + i;
+    }
+    this->Allreduce(offset, count);
+    return vector<Dtype>(this->diff_, this->diff_ + this->size_);
+  }
+};
+
+// Trains one rank on a thread of its own, as each thread has its own solver
+// rank, and keeps the weights it ends up with. The Allreduce is created from
+// the solver and a Config, the same for all ranks.
+template <typename Dtype, typename Allreduce, typename Config>
+class AllreduceRank {
+ public:
+  AllreduceRank(const SolverParameter& param, const Config& config,
+      int rank, int solver_count)
+      : param_(param), config_(config), rank_(rank),
+        solver_count_(solver_count) {
+  }
+
+  void Train() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(solver_count_);
+    Caffe::set_solver_rank(rank_);
+    shared_ptr<Solver<Dtype> > solver(
+        SolverRegistry<Dtype>::CreateSolver(param_));
+    Allreduce allreduce(solver, config_);
+    allreduce.Run();
+    const vector<Blob<Dtype>*>& params = solver->net()->learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      weights_.insert(weights_.end(), params[i]->cpu_data(),
+          params[i]->cpu_data() + params[i]->count());
+    }
+  }
+
+  // Instead of training, reduces known gradients, see KnownValuesAllreduce.
+  void Reduce(size_t offset, size_t count) {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(solver_count_);
+    Caffe::set_solver_rank(rank_);
+    shared_ptr<Solver<Dtype> > solver(
+        SolverRegistry<Dtype>::CreateSolver(param_));
+    KnownValuesAllreduce<Dtype, Allreduce> allreduce(solver, config_);
+    gradients_ = allreduce.Reduce(offset, count);
+  }
+
+  const vector<Dtype>& weights() const { return weights_; }
+  const vector<Dtype>& gradients() const { return gradients_; }
+
+ private:
+  SolverParameter param_;
+  Config config_;
+  int rank_;
+  int solver_count_;
+  vector<Dtype> weights_;
+  vector<Dtype> gradients_;
+};
+
+template <typename Dtype>
+class AllreduceTest : public ::testing::Test {
+ protected:
+  // Trains ranks which start from different weights and see different data,
+  // which only end up with the same weights if their initial weights are
+  // broadcast and their gradients reduced.
+  template <typename Allreduce, typename Config>
+  void TestRanksAgree(const Config& config, int solver_count,
+      bool layer_wise_reduce, int reduce_bucket_size = 262144) {
+    ostringstream proto;
+    proto <<
+       "solver_mode: CPU "
+       "base_lr: 0.1 "
+       "lr_policy: 'fixed' "
+       "momentum: 0.9 "
+       "max_iter: 5 "
+       "random_seed: 1701 "
+       "snapshot_after_train: false "
+       "layer_wise_reduce: " << layer_wise_reduce << " "
+       "reduce_bucket_size: " << reduce_bucket_size << " "
+       "net_param { " << kNetProto << "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    typedef AllreduceRank<Dtype, Allreduce, Config> Rank;
+    vector<shared_ptr<Rank> > ranks;
+    boost::thread_group threads;
+    for (int rank = 0; rank < solver_count; ++rank) {
+      ranks.push_back(shared_ptr<Rank>(
+          new Rank(param, config, rank, solver_count)));
+      threads.create_thread(boost::bind(&Rank::Train, ranks.back().get()));
+    }
+    threads.join_all();
+    const vector<Dtype>& expected = ranks[0]->weights();
+    ASSERT_EQ(11, expected.size());
+    for (int rank = 1; rank < solver_count; ++rank) {
+      const vector<Dtype>& weights = ranks[rank]->weights();
+      ASSERT_EQ(expected.size(), weights.size());
+      for (int i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], weights[i]) << "rank " << rank << " param " << i;
+      }
+    }
+  }
+
+  // Reduces the range [offset, offset + count) of the 11 gradients of ranks
+  // whose gradients are known, which must then be averaged over the ranks
+  // in the range and left as they were out of it.
+  template <typename Allreduce, typename Config>
+  void TestReducesToMean(const Config& config, int solver_count,
+      size_t offset, size_t count) {
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        string("solver_mode: CPU base_lr: 0.1 lr_policy: 'fixed' "
+               "net_param { ") + kNetProto + "} ", &param));
+    typedef AllreduceRank<Dtype, Allreduce, Config> Rank;
+    vector<shared_ptr<Rank> > ranks;
+    boost::thread_group threads;
+    for (int rank = 0; rank < solver_count; ++rank) {
+      ranks.push_back(shared_ptr<Rank>(
+          new Rank(param, config, rank, solver_count)));
+      threads.create_thread(boost::bind(&Rank::Reduce, ranks.back().get(),
+          offset, count));
+    }
+    threads.join_all();
+    // The mean of 100 * r + i over the ranks r.
+    const Dtype mean_offset = Dtype(50) * (solver_count - 1);
+    for (int rank = 0; rank < solver_count; ++rank) {
+      const vector<Dtype>& gradients = ranks[rank]->gradients();
+      ASSERT_EQ(11, gradients.size());
+      for (size_t i = 0; i < gradients.size(); ++i) {
+        const Dtype expected = (i >= offset && i < offset + count) ?
+            i + mean_offset : 100 * rank + i;
+        EXPECT_NEAR(expected, gradients[i], 1e-4)
+            << "rank " << rank << " gradient " << i;
+      }
+    }
+  }
+};
+
+// Endpoints on this machine for the given number of ranks, on ports that
+// were free when asked for.
+static vector<string> LoopbackHosts(int count) {
+  vector<string> hosts;
+  for (int i = 0; i < count; ++i) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0);
+    sockaddr_in address = sockaddr_in();
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&address), length), 0);
+    CHECK_EQ(getsockname(fd, reinterpret_cast<sockaddr*>(&address),
+        &length), 0);
+    hosts.push_back("127.0.0.1:"
+        + boost::lexical_cast<string>(ntohs(address.sin_port)));
+    close(fd);
+  }
+  return hosts;
+}
+
+// Keeps the ranges a BucketScheduler reduces.
+class ReduceRecorder {
+ public:
+  void Reduce(size_t offset, size_t count) {
+    ranges_.push_back(std::make_pair(offset, count));
+  }
+  vector<std::pair<size_t, size_t> > ranges_;
+};
+
+template <typename Dtype>
+class BucketSchedulerTest : public ::testing::Test {
+ protected:
+  BucketSchedulerTest() {
+    Caffe::set_mode(Caffe::CPU);
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(kNetProto, &param));
+    param.mutable_state()->set_phase(TRAIN);
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  // Runs an iteration, returning the ranges reduced in order.
+  vector<std::pair<size_t, size_t> > Schedule(bool overlap,
+      size_t bucket_size) {
+    ReduceRecorder recorder;
+    BucketScheduler<Dtype> scheduler(*net_, overlap, bucket_size,
+        boost::bind(&ReduceRecorder::Reduce, &recorder, _1, _2));
+    if (overlap) {
+      net_->add_after_backward(&scheduler);
+    }
+    net_->ForwardBackward();
+    scheduler.Finish();
+    EXPECT_EQ(1, scheduler.iterations());
+    EXPECT_EQ(recorder.ranges_.size(), scheduler.bucket_count());
+    EXPECT_GE(scheduler.reduce_milliseconds(), 0);
+    EXPECT_GE(scheduler.exposed_milliseconds(), 0);
+    return recorder.ranges_;
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(BucketSchedulerTest, TestDtypes);
+
+TYPED_TEST(BucketSchedulerTest, TestWithoutOverlap) {
+  vector<std::pair<size_t, size_t> > ranges = this->Schedule(false, 1);
+  ASSERT_EQ(1, ranges.size());
+  EXPECT_EQ(0, ranges[0].first);
+  EXPECT_EQ(11, ranges[0].second);
+}
+
+TYPED_TEST(BucketSchedulerTest, TestBucketPerLayer) {
+  // The layers reduced from the top down, as their backward is done.
+  vector<std::pair<size_t, size_t> > ranges = this->Schedule(true, 1);
+  ASSERT_EQ(2, ranges.size());
+  EXPECT_EQ(8, ranges[0].first);
+  EXPECT_EQ(3, ranges[0].second);
+  EXPECT_EQ(0, ranges[1].first);
+  EXPECT_EQ(8, ranges[1].second);
+}
+
+TYPED_TEST(BucketSchedulerTest, TestLayersGrouped) {
+  // The 3 values of the top layer are too few for a bucket of their own.
+  vector<std::pair<size_t, size_t> > ranges = this->Schedule(true, 4);
+  ASSERT_EQ(1, ranges.size());
+  EXPECT_EQ(0, ranges[0].first);
+  EXPECT_EQ(11, ranges[0].second);
+}
+
+TYPED_TEST_CASE(AllreduceTest, TestDtypes);
+
+TYPED_TEST(AllreduceTest, TestShmRanksAgree) {
+  this->template TestRanksAgree<ShmAllreduce<TypeParam> >(
+      ShmAllreduce<TypeParam>::new_name(), 3, false);
+}
+
+TYPED_TEST(AllreduceTest, TestShmRanksAgreeLayerWise) {
+  this->template TestRanksAgree<ShmAllreduce<TypeParam> >(
+      ShmAllreduce<TypeParam>::new_name(), 3, true);
+}
+
+TYPED_TEST(AllreduceTest, TestShmReducesToMean) {
+  // 11 gradients do not split evenly over 3 ranks.
+  this->template TestReducesToMean<ShmAllreduce<TypeParam> >(
+      ShmAllreduce<TypeParam>::new_name(), 3, 0, 11);
+}
+
+TYPED_TEST(AllreduceTest, TestShmReducesRangeToMean) {
+  this->template TestReducesToMean<ShmAllreduce<TypeParam> >(
+      ShmAllreduce<TypeParam>::new_name(), 3, 2, 7);
+}
+
+TYPED_TEST(AllreduceTest, TestTcpRanksAgree) {
+  this->template TestRanksAgree<TcpAllreduce<TypeParam> >(
+      LoopbackHosts(3), 3, false);
+}
+
+TYPED_TEST(AllreduceTest, TestTcpRanksAgreeLayerWise) {
+  this->template TestRanksAgree<TcpAllreduce<TypeParam> >(
+      LoopbackHosts(3), 3, true);
+}
+
+TYPED_TEST(AllreduceTest, TestTcpRanksAgreeBucketPerLayer) {
+  // A bucket for each layer with params.
+  this->template TestRanksAgree<TcpAllreduce<TypeParam> >(
+      LoopbackHosts(3), 3, true, 1);
+}
+
+TYPED_TEST(AllreduceTest, TestTcpReducesToMean) {
+  // Chunks of 3, 4 and 4 gradients go around the ring.
+  this->template TestReducesToMean<TcpAllreduce<TypeParam> >(
+      LoopbackHosts(3), 3, 0, 11);
+}
+
+TYPED_TEST(AllreduceTest, TestTcpReducesRangeToMean) {
+  this->template TestReducesToMean<TcpAllreduce<TypeParam> >(
+      LoopbackHosts(4), 4, 1, 9);
+}
+
+TYPED_TEST(AllreduceTest, TestTcpReducesToMeanTwoRanks) {
+  this->template TestReducesToMean<TcpAllreduce<TypeParam> >(
+      LoopbackHosts(2), 2, 2, 7);
+}
+
+TYPED_TEST(AllreduceTest, TestTcpRanksAgreeTwoRanks) {
+  this->template TestRanksAgree<TcpAllreduce<TypeParam> >(
+      LoopbackHosts(2), 2, true);
+}
+
+// The output of a dropout layer on ones, drawn from the Caffe RNG.
+static vector<float> DropoutMask() {
+  LayerParameter param;
+  param.set_phase(TRAIN);
+  DropoutLayer<float> layer(param);
+  Blob<float> bottom(1, 1, 1, 64);
+  Blob<float> top;
+  caffe_set(bottom.count(), 1.f, bottom.mutable_cpu_data());
+  vector<Blob<float>*> bottom_vec(1, &bottom);
+  vector<Blob<float>*> top_vec(1, &top);
+  layer.SetUp(bottom_vec, top_vec);
+  layer.Forward(bottom_vec, top_vec);
+  return vector<float>(top.cpu_data(), top.cpu_data() + top.count());
+}
+
+TEST(ForkSolversTest, TestRanksDrawDifferently) {
+  Caffe::set_mode(Caffe::CPU);
+  // Rank 0 has used its generator before forking, as the caffe tool does,
+  // and no random_seed is set.
+  caffe_rng_rand();
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  Caffe::set_solver_count(2);
+  const vector<pid_t> children = ShmAllreduce<float>::fork_solvers();
+  const vector<float> mask = DropoutMask();
+  const size_t bytes = mask.size() * sizeof(float);
+  if (children.empty()) {
+    const bool sent = write(fds[1], &mask[0], bytes) == bytes;
+    _exit(sent ? 0 : 1);
+  }
+  Caffe::set_solver_count(1);
+  ASSERT_EQ(1, children.size());
+  vector<float> child_mask(mask.size());
+  size_t received = 0;
+  while (received < bytes) {
+    const ssize_t n = read(fds[0],
+        reinterpret_cast<char*>(&child_mask[0]) + received, bytes - received);
+    ASSERT_GT(n, 0);
+    received += n;
+  }
+  int status;
+  ASSERT_EQ(children[0], waitpid(children[0], &status, 0));
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  close(fds[0]);
+  close(fds[1]);
+  EXPECT_NE(mask, child_mask);
+}
+
+}  // namespace caffe
@@ -50,6 +50,15 @@ TEST_F(SyncedMemoryTest, TestAllocationGPU) {
 
 #endif
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  const int version = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), version);
+  mem.mutable_cpu_data();
+  EXPECT_GT(mem.version(), version);
+}
+
 TEST_F(SyncedMemoryTest, TestCPUWrite) {
   SyncedMemory mem(10);
   void* cpu_data = mem.mutable_cpu_data();
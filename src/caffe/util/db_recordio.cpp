@@ -0,0 +1,152 @@
+#include "caffe/util/db_recordio.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace caffe { namespace db {
+
+static const char* kRecordsFile = "/records";
+static const char* kIndexFile = "/index";
+
+// Maps a whole file for reading, or returns NULL if it is empty.
+static void* MapFile(const string& path, size_t* size) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Failed to open " << path;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Failed to stat " << path;
+  *size = file_stat.st_size;
+  void* data = NULL;
+  if (*size > 0) {
+    data = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    CHECK(data != MAP_FAILED) << "Failed to map " << path;
+  }
+  close(fd);
+  return data;
+}
+
+void RecordIO::Open(const string& source, Mode mode) {
+  source_ = source;
+  mode_ = mode;
+  if (mode == NEW) {
+    CHECK_EQ(mkdir(source.c_str(), 0744), 0) << "mkdir " << source << " failed";
+  }
+  if (mode == READ) {
+    records_ = MapFile(source + kRecordsFile, &records_size_);
+    offsets_ = MapFile(source + kIndexFile, &offsets_size_);
+    CHECK_EQ(offsets_size_ % sizeof(uint64_t), 0)
+        << "Truncated index in " << source;
+  } else {
+    // Transactions append to the files, which are created if needed.
+    const char* files[] = {kRecordsFile, kIndexFile};
+    for (int i = 0; i < 2; ++i) {
+      FILE* file = fopen((source + files[i]).c_str(), "ab");
+      CHECK(file) << "Failed to open " << source << files[i];
+      CHECK_EQ(fclose(file), 0);
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Opened recordio " << source;
+}
+
+void RecordIO::Close() {
+  if (records_ != NULL) {
+    munmap(records_, records_size_);
+    records_ = NULL;
+  }
+  if (offsets_ != NULL) {
+    munmap(offsets_, offsets_size_);
+    offsets_ = NULL;
+  }
+  records_size_ = offsets_size_ = 0;
+}
+
+RecordIOCursor* RecordIO::NewCursor() {
+  CHECK_EQ(mode_, READ) << "Reading a recordio db requires opening it as READ";
+  return new RecordIOCursor(static_cast<const char*>(records_),
+      records_size_, static_cast<const uint64_t*>(offsets_),
+      offsets_size_ / sizeof(uint64_t));
+}
+
+RecordIOTransaction* RecordIO::NewTransaction() {
+  CHECK_NE(mode_, READ) << "Writing a recordio db requires opening it as "
+      << "WRITE or NEW";
+  return new RecordIOTransaction(source_);
+}
+
+void RecordIOCursor::Move(size_t position) {
+  position_ = position;
+  if (!valid()) {
+    return;
+  }
+  // Records are not aligned, so their header is copied out.
+  const uint64_t offset = offsets_[position];
+  CHECK_LE(offset + 2 * sizeof(uint32_t), records_size_)
+      << "Truncated record " << position;
+  const char* record = records_ + offset;
+  memcpy(&key_size_, record, sizeof(uint32_t));
+  memcpy(&value_size_, record + sizeof(uint32_t), sizeof(uint32_t));
+  key_data_ = record + 2 * sizeof(uint32_t);
+  value_data_ = key_data_ + key_size_;
+  CHECK_LE(offset + 2 * sizeof(uint32_t) + key_size_ + value_size_,
+      records_size_) << "Truncated record " << position;
+}
+
+void RecordIOCursor::Seek(const string& key) {
+  if (positions_.empty()) {
+    for (Move(0); valid(); Move(position_ + 1)) {
+      positions_[this->key()] = position_;
+    }
+  }
+  std::map<string, size_t>::const_iterator it = positions_.find(key);
+  CHECK(it != positions_.end()) << "Key not found: " << key;
+  Move(it->second);
+}
+
+void RecordIOTransaction::Put(const string& key, const string& value) {
+  CHECK_LE(key.size(), std::numeric_limits<uint32_t>::max());
+  CHECK_LE(value.size(), std::numeric_limits<uint32_t>::max());
+  offsets_.push_back(records_.size());
+  const uint32_t sizes[] = {static_cast<uint32_t>(key.size()),
+      static_cast<uint32_t>(value.size())};
+  records_.append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+  records_.append(key);
+  records_.append(value);
+}
+
+void RecordIOTransaction::Commit() {
+  // The records are written before the index, so that the index only ever
+  // points to complete records.
+  const string records_path = source_ + kRecordsFile;
+  FILE* records = fopen(records_path.c_str(), "ab");
+  CHECK(records) << "Failed to open " << records_path;
+  CHECK_EQ(fseeko(records, 0, SEEK_END), 0);
+  const off_t base = ftello(records);
+  CHECK_GE(base, 0) << "Failed to find the end of " << records_path;
+  CHECK_EQ(fwrite(records_.data(), 1, records_.size(), records),
+      records_.size()) << "Failed to write " << records_path;
+  CHECK_EQ(fclose(records), 0) << "Failed to write " << records_path;
+
+  for (int i = 0; i < offsets_.size(); ++i) {
+    offsets_[i] += base;
+  }
+  const string index_path = source_ + kIndexFile;
+  FILE* index = fopen(index_path.c_str(), "ab");
+  CHECK(index) << "Failed to open " << index_path;
+  if (!offsets_.empty()) {
+    CHECK_EQ(fwrite(&offsets_[0], sizeof(uint64_t), offsets_.size(), index),
+        offsets_.size()) << "Failed to write " << index_path;
+  }
+  CHECK_EQ(fclose(index), 0) << "Failed to write " << index_path;
+
+  records_.clear();
+  offsets_.clear();
+}
+
+}  // namespace db
+}  // namespace caffe
@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/flat_blobs.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+shared_ptr<SyncedMemory> FlattenBlobs(const vector<Blob<Dtype>*>& blobs,
+    bool diff) {
+  size_t count = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    count += blobs[i]->count();
+  }
+  // Keep at least one element, as for a net without params.
+  shared_ptr<SyncedMemory> flat(new SyncedMemory(
+      std::max(count, size_t(1)) * sizeof(Dtype)));
+  Dtype* ptr = static_cast<Dtype*>(flat->mutable_cpu_data());
+  for (int i = 0; i < blobs.size(); ++i) {
+    const int n = blobs[i]->count();
+    if (n == 0) {
+      continue;
+    }
+    const shared_ptr<SyncedMemory>& memory =
+        diff ? blobs[i]->diff() : blobs[i]->data();
+    CHECK_EQ(memory->size(), n * sizeof(Dtype))
+        << "Only blobs that fill their memory can be flattened.";
+    caffe_copy(n, static_cast<const Dtype*>(memory->cpu_data()), ptr);
+    memory->set_cpu_data(ptr);
+    ptr += n;
+  }
+  return flat;
+}
+
+template <typename Dtype>
+bool BlobsAreFlat(const vector<Blob<Dtype>*>& blobs, bool diff,
+    SyncedMemory* flat) {
+  const Dtype* ptr = static_cast<const Dtype*>(flat->cpu_data());
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (blobs[i]->count() == 0) {
+      continue;
+    }
+    if ((diff ? blobs[i]->cpu_diff() : blobs[i]->cpu_data()) != ptr) {
+      return false;
+    }
+    ptr += blobs[i]->count();
+  }
+  return true;
+}
+
+template shared_ptr<SyncedMemory> FlattenBlobs<float>(
+    const vector<Blob<float>*>& blobs, bool diff);
+template shared_ptr<SyncedMemory> FlattenBlobs<double>(
+    const vector<Blob<double>*>& blobs, bool diff);
+template bool BlobsAreFlat<float>(const vector<Blob<float>*>& blobs,
+    bool diff, SyncedMemory* flat);
+template bool BlobsAreFlat<double>(const vector<Blob<double>*>& blobs,
+    bool diff, SyncedMemory* flat);
+
+}  // namespace caffe
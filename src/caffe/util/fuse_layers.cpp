@@ -0,0 +1,196 @@
+#include <cmath>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fuse_layers.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Whether any of the layer's params is shared with other layers by name.
+static bool SharesParams(const LayerParameter& layer_param) {
+  for (int i = 0; i < layer_param.param_size(); ++i) {
+    if (layer_param.param(i).name().size()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether a layer that consumes the output of a fusable Convolution, so far
+// followed by the folded or fused layers recorded in the flags, can join it.
+// Folding rewrites the convolution's weights, so it is ruled out when the
+// convolution shares them.
+static bool CanFuse(const LayerParameter& layer_param, const bool folded_bn,
+    const bool folded_scale, const bool fused_relu, const bool shared_conv) {
+  if (layer_param.bottom_size() != 1 || layer_param.top_size() != 1 ||
+      layer_param.blobs_size() > 0 || layer_param.loss_weight_size() > 0 ||
+      fused_relu) {
+    return false;
+  }
+  if (layer_param.type() != "ReLU" &&
+      (shared_conv || SharesParams(layer_param))) {
+    return false;
+  }
+  if (layer_param.type() == "BatchNorm") {
+    // Only a BatchNorm that normalizes with its stored statistics is affine.
+    return !folded_bn && !folded_scale &&
+        (!layer_param.batch_norm_param().has_use_global_stats() ||
+         layer_param.batch_norm_param().use_global_stats());
+  }
+  if (layer_param.type() == "Scale") {
+    const ScaleParameter& scale_param = layer_param.scale_param();
+    return !folded_scale && scale_param.axis() == 1 &&
+        scale_param.num_axes() == 1;
+  }
+  return layer_param.type() == "ReLU";
+}
+
+void FuseLayers(const NetParameter& param, NetParameter* param_fused,
+    map<string, vector<LayerParameter> >* folded_layers) {
+  // Initialize by copying from the input NetParameter.
+  param_fused->CopyFrom(param);
+  param_fused->clear_layer();
+  folded_layers->clear();
+  // Count the consumers of each top blob, as InsertSplits does.
+  map<string, pair<int, int> > blob_name_to_last_top_idx;
+  map<pair<int, int>, int> top_idx_to_bottom_count;
+  map<pair<int, int>, int> top_idx_to_consumer;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      if (blob_name_to_last_top_idx.find(blob_name) ==
+          blob_name_to_last_top_idx.end()) {
+        LOG(FATAL) << "Unknown bottom blob '" << blob_name << "' (layer '"
+                   << layer_param.name() << "', bottom index " << j << ")";
+      }
+      const pair<int, int>& top_idx = blob_name_to_last_top_idx[blob_name];
+      ++top_idx_to_bottom_count[top_idx];
+      top_idx_to_consumer[top_idx] = i;
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      blob_name_to_last_top_idx[layer_param.top(j)] = make_pair(i, j);
+    }
+    for (int j = 0; j < layer_param.loss_weight_size(); ++j) {
+      if (layer_param.loss_weight(j)) {
+        ++top_idx_to_bottom_count[make_pair(i, j)];
+      }
+    }
+  }
+  vector<bool> fused(param.layer_size(), false);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (fused[i]) {
+      continue;
+    }
+    LayerParameter* layer_param = param_fused->add_layer();
+    layer_param->CopyFrom(param.layer(i));
+    if (layer_param->type() != "Convolution" ||
+        layer_param->bottom_size() != 1 || layer_param->top_size() != 1 ||
+        layer_param->blobs_size() > 0 ||
+        layer_param->convolution_param().axis() != 1) {
+      continue;
+    }
+    ConvolutionParameter* conv_param =
+        layer_param->mutable_convolution_param();
+    bool folded_bn = false;
+    bool folded_scale = false;
+    bool fused_relu = conv_param->fused_relu();
+    const bool shared_conv = SharesParams(*layer_param);
+    // Follow the chain of single consumers from the convolution's output.
+    for (int current = i; ; ) {
+      const pair<int, int> top_idx = make_pair(current, 0);
+      if (top_idx_to_bottom_count[top_idx] != 1) {
+        break;
+      }
+      const int next = top_idx_to_consumer[top_idx];
+      const LayerParameter& next_param = param.layer(next);
+      if (!CanFuse(next_param, folded_bn, folded_scale, fused_relu,
+          shared_conv)) {
+        break;
+      }
+      if (next_param.type() == "ReLU") {
+        conv_param->set_fused_relu(true);
+        conv_param->set_fused_relu_negative_slope(
+            next_param.relu_param().negative_slope());
+        fused_relu = true;
+      } else {
+        (*folded_layers)[layer_param->name()].push_back(next_param);
+        folded_bn |= next_param.type() == "BatchNorm";
+        folded_scale |= next_param.type() == "Scale";
+        conv_param->set_bias_term(true);
+      }
+      layer_param->set_top(0, next_param.top(0));
+      fused[next] = true;
+      current = next;
+    }
+    if (folded_bn || folded_scale || fused_relu) {
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Fusing into " << layer_param->name() << " up to its top "
+          << layer_param->top(0);
+    }
+  }
+}
+
+template <typename Dtype>
+void FoldIntoConvolution(const LayerParameter& folded_layer,
+    const vector<shared_ptr<Blob<Dtype> > >& folded_blobs,
+    const vector<shared_ptr<Blob<Dtype> > >& conv_blobs) {
+  CHECK_EQ(conv_blobs.size(), 2)
+      << "Folding " << folded_layer.name() << " needs a convolution bias";
+  Blob<Dtype>* weight = conv_blobs[0].get();
+  Blob<Dtype>* bias = conv_blobs[1].get();
+  const int num_output = weight->shape(0);
+  const int weight_dim = weight->count(1);
+  CHECK_EQ(bias->count(), num_output);
+  // The folded layer computes y = x * scale[c] + shift[c] per channel c.
+  vector<Dtype> scale(num_output);
+  vector<Dtype> shift(num_output, Dtype(0));
+  if (folded_layer.type() == "BatchNorm") {
+    CHECK_EQ(folded_blobs.size(), 3)
+        << "Incorrect number of blobs for BatchNorm " << folded_layer.name();
+    CHECK_EQ(folded_blobs[0]->count(), num_output);
+    CHECK_EQ(folded_blobs[1]->count(), num_output);
+    const Dtype* mean = folded_blobs[0]->cpu_data();
+    const Dtype* variance = folded_blobs[1]->cpu_data();
+    // The statistics are stored scaled by the moving average factor.
+    const Dtype factor = folded_blobs[2]->cpu_data()[0];
+    const Dtype scale_factor = factor == 0 ? 0 : 1 / factor;
+    const Dtype eps = folded_layer.batch_norm_param().eps();
+    for (int c = 0; c < num_output; ++c) {
+      scale[c] = 1 / std::sqrt(variance[c] * scale_factor + eps);
+      shift[c] = -mean[c] * scale_factor * scale[c];
+    }
+  } else if (folded_layer.type() == "Scale") {
+    const bool bias_term = folded_layer.scale_param().bias_term();
+    CHECK_EQ(folded_blobs.size(), 1 + bias_term)
+        << "Incorrect number of blobs for Scale " << folded_layer.name();
+    CHECK_EQ(folded_blobs[0]->count(), num_output);
+    caffe_copy(num_output, folded_blobs[0]->cpu_data(), &scale[0]);
+    if (bias_term) {
+      CHECK_EQ(folded_blobs[1]->count(), num_output);
+      caffe_copy(num_output, folded_blobs[1]->cpu_data(), &shift[0]);
+    }
+  } else {
+    LOG(FATAL) << "Cannot fold " << folded_layer.type() << " layer "
+               << folded_layer.name() << " into a convolution";
+  }
+  Dtype* weight_data = weight->mutable_cpu_data();
+  Dtype* bias_data = bias->mutable_cpu_data();
+  for (int c = 0; c < num_output; ++c) {
+    caffe_scal(weight_dim, scale[c], weight_data + c * weight_dim);
+    bias_data[c] = bias_data[c] * scale[c] + shift[c];
+  }
+}
+
+template void FoldIntoConvolution<float>(const LayerParameter& folded_layer,
+    const vector<shared_ptr<Blob<float> > >& folded_blobs,
+    const vector<shared_ptr<Blob<float> > >& conv_blobs);
+template void FoldIntoConvolution<double>(const LayerParameter& folded_layer,
+    const vector<shared_ptr<Blob<double> > >& folded_blobs,
+    const vector<shared_ptr<Blob<double> > >& conv_blobs);
+
+}  // namespace caffe
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+// The number of elements of A converted at a time by caffe_cpu_half_gemm,
+// chosen for the converted block to stay in a per-core cache.
+static const int kHalfGemmBlockSize = 32768;
+
+// caffe_cpu_half_gemm splits the rows of A over the threads itself only for
+// products up to this many columns wide, which are bound by reading A and too
+// narrow for the BLAS gemm to split. Wider ones are left to the BLAS threads.
+static const int kHalfGemmMaxParallelN = 32;
+
+template <typename Dtype>
+void caffe_cpu_to_half(const int n, const Dtype* x, const StorageType type,
+    uint16_t* y) {
+  CHECK(type == FLOAT16 || type == BFLOAT16)
+      << "Not a 16-bit storage type: " << StorageType_Name(type);
+  if (type == FLOAT16) {
+    CAFFE_PARALLEL_FOR_IF(n >= CAFFE_PARALLEL_MIN_COUNT)
+    for (int i = 0; i < n; ++i) {
+      y[i] = float_to_fp16(static_cast<float>(x[i]));
+    }
+  } else {
+    CAFFE_PARALLEL_FOR_IF(n >= CAFFE_PARALLEL_MIN_COUNT)
+    for (int i = 0; i < n; ++i) {
+      y[i] = float_to_bf16(static_cast<float>(x[i]));
+    }
+  }
+}
+
+template void caffe_cpu_to_half<float>(const int n, const float* x,
+    const StorageType type, uint16_t* y);
+template void caffe_cpu_to_half<double>(const int n, const double* x,
+    const StorageType type, uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int n, const uint16_t* x,
+    const StorageType type, Dtype* y) {
+  CHECK(type == FLOAT16 || type == BFLOAT16)
+      << "Not a 16-bit storage type: " << StorageType_Name(type);
+  if (type == FLOAT16) {
+    CAFFE_PARALLEL_FOR_IF(n >= CAFFE_PARALLEL_MIN_COUNT)
+    for (int i = 0; i < n; ++i) {
+      y[i] = fp16_to_float(x[i]);
+    }
+  } else {
+    CAFFE_PARALLEL_FOR_IF(n >= CAFFE_PARALLEL_MIN_COUNT)
+    for (int i = 0; i < n; ++i) {
+      y[i] = bf16_to_float(x[i]);
+    }
+  }
+}
+
+template void caffe_cpu_from_half<float>(const int n, const uint16_t* x,
+    const StorageType type, float* y);
+template void caffe_cpu_from_half<double>(const int n, const uint16_t* x,
+    const StorageType type, double* y);
+
+// A serial C = A * op(B) for the narrow products of caffe_cpu_half_gemm, run
+// on its threads, with the inner loops over contiguous memory.
+template <typename Dtype>
+static void half_gemm_block(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype* A, const Dtype* B, Dtype* C) {
+  for (int i = 0; i < M; ++i) {
+    const Dtype* A_row = A + static_cast<int64_t>(i) * K;
+    Dtype* C_row = C + static_cast<int64_t>(i) * N;
+    if (TransB == CblasTrans) {
+      for (int j = 0; j < N; ++j) {
+        const Dtype* B_row = B + static_cast<int64_t>(j) * K;
+        Dtype sum = 0;
+        for (int k = 0; k < K; ++k) {
+          sum += A_row[k] * B_row[k];
+        }
+        C_row[j] = sum;
+      }
+    } else {
+      for (int j = 0; j < N; ++j) {
+        C_row[j] = 0;
+      }
+      for (int k = 0; k < K; ++k) {
+        const Dtype a = A_row[k];
+        const Dtype* B_row = B + static_cast<int64_t>(k) * N;
+        for (int j = 0; j < N; ++j) {
+          C_row[j] += a * B_row[j];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_half_gemm(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const uint16_t* A, const StorageType type,
+    const Dtype* B, Dtype* C) {
+  const int block_rows = std::max(1, std::min(M, kHalfGemmBlockSize / K));
+  const int num_blocks = (M + block_rows - 1) / block_rows;
+  const int64_t work = static_cast<int64_t>(M) * N * K;
+  const int num_runs = std::min(num_blocks, Caffe::num_threads());
+  if (N > kHalfGemmMaxParallelN || num_runs == 1 ||
+      work < CAFFE_PARALLEL_MIN_COUNT) {
+    // One block at a time, each converted in parallel and then multiplied by
+    // the BLAS gemm on its own threads.
+    vector<Dtype> A_block(block_rows * K);
+    for (int block = 0; block < num_blocks; ++block) {
+      const int row = block * block_rows;
+      const int rows = std::min(block_rows, M - row);
+      caffe_cpu_from_half(rows * K, A + static_cast<int64_t>(row) * K, type,
+          &A_block[0]);
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, TransB, rows, N, K, (Dtype)1.,
+          &A_block[0], B, (Dtype)0., C + static_cast<int64_t>(row) * N);
+    }
+    return;
+  }
+  // Each block of rows of C only depends on the same rows of A. The blocks
+  // are split into one contiguous run per thread, which converts them into a
+  // buffer of its own.
+  CAFFE_PARALLEL_FOR
+  for (int run = 0; run < num_runs; ++run) {
+    const int block_begin = num_blocks * run / num_runs;
+    const int block_end = num_blocks * (run + 1) / num_runs;
+    vector<Dtype> A_block(block_rows * K);
+    for (int block = block_begin; block < block_end; ++block) {
+      const int row = block * block_rows;
+      const int rows = std::min(block_rows, M - row);
+      caffe_cpu_from_half(rows * K, A + static_cast<int64_t>(row) * K, type,
+          &A_block[0]);
+      half_gemm_block(TransB, rows, N, K, &A_block[0], B,
+          C + static_cast<int64_t>(row) * N);
+    }
+  }
+}
+
+template void caffe_cpu_half_gemm<float>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const uint16_t* A,
+    const StorageType type, const float* B, float* C);
+template void caffe_cpu_half_gemm<double>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const uint16_t* A,
+    const StorageType type, const double* B, double* C);
+
+bool ConvertBlobProtoData(const StorageType type, BlobProto* proto) {
+  vector<float> data_vec;
+  if (proto->double_data_size() > 0) {
+    data_vec.assign(proto->double_data().begin(), proto->double_data().end());
+  } else {
+    data_vec.assign(proto->data().begin(), proto->data().end());
+  }
+  const int count = data_vec.size();
+  vector<uint16_t> half_vec(count);
+  if (count > 0) {
+    caffe_cpu_to_half(count, &data_vec[0], type, &half_vec[0]);
+  }
+  for (int i = 0; i < count; ++i) {
+    const float value = type == FLOAT16 ?
+        fp16_to_float(half_vec[i]) : bf16_to_float(half_vec[i]);
+    if ((std::isinf(value) && !std::isinf(data_vec[i]))
+        || (value == 0 && data_vec[i] != 0)) {
+      return false;
+    }
+  }
+  string half_data(2 * count, 0);
+  for (int i = 0; i < count; ++i) {
+    half_data[2 * i] = static_cast<char>(half_vec[i] & 0xff);
+    half_data[2 * i + 1] = static_cast<char>(half_vec[i] >> 8);
+  }
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->set_half_data(half_data);
+  proto->set_half_type(type);
+  return true;
+}
+
+}  // namespace caffe
@@ -1,16 +1,33 @@
 #ifdef USE_HDF5
 #include "caffe/util/hdf5.hpp"
 
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
 namespace caffe {
 
+// Never destroyed, since layers may close their files during static
+// destruction.
+static boost::recursive_mutex& hdf5_mutex() {
+  static boost::recursive_mutex* mutex = new boost::recursive_mutex();
+  return *mutex;
+}
+
+HDF5Lock::HDF5Lock() {
+  hdf5_mutex().lock();
+}
+
+HDF5Lock::~HDF5Lock() {
+  hdf5_mutex().unlock();
+}
+
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape) {
+  HDF5Lock lock;
   // Verify that the dataset exists.
   CHECK(H5LTfind_dataset(file_id, dataset_name_))
       << "Failed to find HDF5 dataset " << dataset_name_;
@@ -87,6 +104,7 @@ void hdf5_load_nd_dataset_helper(
 template <>
 void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<float>* blob, bool reshape) {
+  HDF5Lock lock;
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob,
                               reshape);
   herr_t status = H5LTread_dataset_float(
@@ -97,6 +115,7 @@ void hdf5_load_nd_dataset<float>(hid_t file_id, const char* dataset_name_,
 template <>
 void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
         int min_dim, int max_dim, Blob<double>* blob, bool reshape) {
+  HDF5Lock lock;
   hdf5_load_nd_dataset_helper(file_id, dataset_name_, min_dim, max_dim, blob,
                               reshape);
   herr_t status = H5LTread_dataset_double(
@@ -104,10 +123,86 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+// Selects the rows of the dataset, checking its format, and reads them with
+// the given memory type.
+template <typename Dtype>
+static void hdf5_load_nd_dataset_rows_helper(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    hsize_t start, hsize_t count, hid_t mem_type_id, Blob<Dtype>* blob) {
+  HDF5Lock lock;
+  CHECK(H5LTfind_dataset(file_id, dataset_name_))
+      << "Failed to find HDF5 dataset " << dataset_name_;
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open HDF5 dataset " << dataset_name_;
+  hid_t type_id = H5Dget_type(dataset_id);
+  const H5T_class_t class_ = H5Tget_class(type_id);
+  H5Tclose(type_id);
+  CHECK(class_ == H5T_FLOAT || class_ == H5T_INTEGER)
+      << "Unsupported datatype class of dataset " << dataset_name_;
+  hid_t file_space_id = H5Dget_space(dataset_id);
+  const int ndims = H5Sget_simple_extent_ndims(file_space_id);
+  CHECK_GE(ndims, min_dim);
+  CHECK_LE(ndims, max_dim);
+  std::vector<hsize_t> dims(ndims);
+  H5Sget_simple_extent_dims(file_space_id, dims.data(), NULL);
+  CHECK_LE(start + count, dims[0])
+      << "Rows out of range of HDF5 dataset " << dataset_name_;
+
+  std::vector<hsize_t> offset(ndims, 0);
+  offset[0] = start;
+  dims[0] = count;
+  herr_t status = H5Sselect_hyperslab(file_space_id, H5S_SELECT_SET,
+      offset.data(), NULL, dims.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of dataset " << dataset_name_;
+  hid_t mem_space_id = H5Screate_simple(ndims, dims.data(), NULL);
+  vector<int> blob_dims(dims.begin(), dims.end());
+  blob->Reshape(blob_dims);
+  status = H5Dread(dataset_id, mem_type_id, mem_space_id, file_space_id,
+      H5P_DEFAULT, blob->mutable_cpu_data());
+  CHECK_GE(status, 0) << "Failed to read rows of dataset " << dataset_name_;
+  H5Sclose(mem_space_id);
+  H5Sclose(file_space_id);
+  H5Dclose(dataset_id);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(hid_t file_id, const char* dataset_name_,
+        int min_dim, int max_dim, hsize_t start, hsize_t count,
+        Blob<float>* blob) {
+  HDF5Lock lock;
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, min_dim, max_dim,
+                                   start, count, H5T_NATIVE_FLOAT, blob);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(hid_t file_id,
+        const char* dataset_name_, int min_dim, int max_dim, hsize_t start,
+        hsize_t count, Blob<double>* blob) {
+  HDF5Lock lock;
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, min_dim, max_dim,
+                                   start, count, H5T_NATIVE_DOUBLE, blob);
+}
+
+hsize_t hdf5_get_num_rows(hid_t file_id, const char* dataset_name_) {
+  HDF5Lock lock;
+  CHECK(H5LTfind_dataset(file_id, dataset_name_))
+      << "Failed to find HDF5 dataset " << dataset_name_;
+  int ndims;
+  herr_t status = H5LTget_dataset_ndims(file_id, dataset_name_, &ndims);
+  CHECK_GE(status, 0) << "Failed to get dataset ndims for " << dataset_name_;
+  CHECK_GE(ndims, 1) << "Input must have at least 1 axis.";
+  std::vector<hsize_t> dims(ndims);
+  status = H5LTget_dataset_info(file_id, dataset_name_, dims.data(), NULL,
+                                NULL);
+  CHECK_GE(status, 0) << "Failed to get dataset info for " << dataset_name_;
+  return dims[0];
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
     bool write_diff) {
+  HDF5Lock lock;
   int num_axes = blob.num_axes();
   hsize_t *dims = new hsize_t[num_axes];
   for (int i = 0; i < num_axes; ++i) {
@@ -129,6 +224,7 @@ template <>
 void hdf5_save_nd_dataset<double>(
     hid_t file_id, const string& dataset_name, const Blob<double>& blob,
     bool write_diff) {
+  HDF5Lock lock;
   int num_axes = blob.num_axes();
   hsize_t *dims = new hsize_t[num_axes];
   for (int i = 0; i < num_axes; ++i) {
@@ -146,7 +242,113 @@ void hdf5_save_nd_dataset<double>(
   delete[] dims;
 }
 
+static void hdf5_create_extendible_dataset_helper(
+    hid_t file_id, const string& dataset_name, const vector<int>& row_shape,
+    hsize_t chunk_rows, int compression, hid_t type_id) {
+  HDF5Lock lock;
+  CHECK_GT(chunk_rows, 0) << "Chunks must have rows";
+  const int ndims = row_shape.size() + 1;
+  std::vector<hsize_t> dims(ndims, 0);
+  std::vector<hsize_t> max_dims(ndims, H5S_UNLIMITED);
+  std::vector<hsize_t> chunk_dims(ndims, chunk_rows);
+  for (int i = 1; i < ndims; ++i) {
+    dims[i] = max_dims[i] = chunk_dims[i] = row_shape[i - 1];
+  }
+  hid_t space_id = H5Screate_simple(ndims, dims.data(), max_dims.data());
+  CHECK_GE(space_id, 0) << "Failed to create dataspace for " << dataset_name;
+  hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+  herr_t status = H5Pset_chunk(plist_id, ndims, chunk_dims.data());
+  CHECK_GE(status, 0) << "Failed to set chunks of dataset " << dataset_name;
+  if (compression > 0) {
+    status = H5Pset_deflate(plist_id, compression);
+    CHECK_GE(status, 0) << "Failed to set compression of dataset "
+        << dataset_name;
+  }
+  hid_t dataset_id = H5Dcreate2(file_id, dataset_name.c_str(), type_id,
+      space_id, H5P_DEFAULT, plist_id, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to make dataset " << dataset_name;
+  H5Dclose(dataset_id);
+  H5Pclose(plist_id);
+  H5Sclose(space_id);
+}
+
+template <>
+void hdf5_create_extendible_dataset<float>(
+    hid_t file_id, const string& dataset_name, const vector<int>& row_shape,
+    hsize_t chunk_rows, int compression) {
+  HDF5Lock lock;
+  hdf5_create_extendible_dataset_helper(file_id, dataset_name, row_shape,
+      chunk_rows, compression, H5T_NATIVE_FLOAT);
+}
+
+template <>
+void hdf5_create_extendible_dataset<double>(
+    hid_t file_id, const string& dataset_name, const vector<int>& row_shape,
+    hsize_t chunk_rows, int compression) {
+  HDF5Lock lock;
+  hdf5_create_extendible_dataset_helper(file_id, dataset_name, row_shape,
+      chunk_rows, compression, H5T_NATIVE_DOUBLE);
+}
+
+template <typename Dtype>
+static void hdf5_append_nd_dataset_helper(
+    hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
+    hid_t mem_type_id) {
+  HDF5Lock lock;
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name.c_str(), H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open HDF5 dataset " << dataset_name;
+  hid_t file_space_id = H5Dget_space(dataset_id);
+  const int ndims = H5Sget_simple_extent_ndims(file_space_id);
+  CHECK_EQ(ndims, blob.num_axes())
+      << "Cannot append blob of shape " << blob.shape_string()
+      << " to dataset " << dataset_name;
+  std::vector<hsize_t> dims(ndims);
+  H5Sget_simple_extent_dims(file_space_id, dims.data(), NULL);
+  H5Sclose(file_space_id);
+  for (int i = 1; i < ndims; ++i) {
+    CHECK_EQ(dims[i], blob.shape(i))
+        << "Cannot append blob of shape " << blob.shape_string()
+        << " to dataset " << dataset_name;
+  }
+
+  // Extend the dataset by the rows of the blob, and write them at its end.
+  std::vector<hsize_t> offset(ndims, 0);
+  offset[0] = dims[0];
+  dims[0] += blob.shape(0);
+  herr_t status = H5Dset_extent(dataset_id, dims.data());
+  CHECK_GE(status, 0) << "Failed to extend dataset " << dataset_name;
+  file_space_id = H5Dget_space(dataset_id);
+  dims[0] = blob.shape(0);
+  status = H5Sselect_hyperslab(file_space_id, H5S_SELECT_SET,
+      offset.data(), NULL, dims.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of dataset " << dataset_name;
+  hid_t mem_space_id = H5Screate_simple(ndims, dims.data(), NULL);
+  status = H5Dwrite(dataset_id, mem_type_id, mem_space_id, file_space_id,
+      H5P_DEFAULT, blob.cpu_data());
+  CHECK_GE(status, 0) << "Failed to append to dataset " << dataset_name;
+  H5Sclose(mem_space_id);
+  H5Sclose(file_space_id);
+  H5Dclose(dataset_id);
+}
+
+template <>
+void hdf5_append_nd_dataset<float>(
+    hid_t file_id, const string& dataset_name, const Blob<float>& blob) {
+  HDF5Lock lock;
+  hdf5_append_nd_dataset_helper(file_id, dataset_name, blob,
+      H5T_NATIVE_FLOAT);
+}
+
+template <>
+void hdf5_append_nd_dataset<double>(
+    hid_t file_id, const string& dataset_name, const Blob<double>& blob) {
+  HDF5Lock lock;
+  hdf5_append_nd_dataset_helper(file_id, dataset_name, blob,
+      H5T_NATIVE_DOUBLE);
+}
+
 string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
+  HDF5Lock lock;
   // Get size of dataset
   size_t size;
   H5T_class_t class_;
@@ -164,6 +366,7 @@ string hdf5_load_string(hid_t loc_id, const string& dataset_name) {
 
 void hdf5_save_string(hid_t loc_id, const string& dataset_name,
                       const string& s) {
+  HDF5Lock lock;
   herr_t status = \
     H5LTmake_dataset_string(loc_id, dataset_name.c_str(), s.c_str());
   CHECK_GE(status, 0)
@@ -171,6 +374,7 @@ void hdf5_save_string(hid_t loc_id, const string& dataset_name,
 }
 
 int hdf5_load_int(hid_t loc_id, const string& dataset_name) {
+  HDF5Lock lock;
   int val;
   herr_t status = H5LTread_dataset_int(loc_id, dataset_name.c_str(), &val);
   CHECK_GE(status, 0)
@@ -179,6 +383,7 @@ int hdf5_load_int(hid_t loc_id, const string& dataset_name) {
 }
 
 void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i) {
+  HDF5Lock lock;
   hsize_t one = 1;
   herr_t status = \
     H5LTmake_dataset_int(loc_id, dataset_name.c_str(), 1, &one, &i);
@@ -187,6 +392,7 @@ void hdf5_save_int(hid_t loc_id, const string& dataset_name, int i) {
 }
 
 int hdf5_get_num_links(hid_t loc_id) {
+  HDF5Lock lock;
   H5G_info_t info;
   herr_t status = H5Gget_info(loc_id, &info);
   CHECK_GE(status, 0) << "Error while counting HDF5 links.";
@@ -194,6 +400,7 @@ int hdf5_get_num_links(hid_t loc_id) {
 }
 
 string hdf5_get_name_by_idx(hid_t loc_id, int idx) {
+  HDF5Lock lock;
   ssize_t str_size = H5Lget_name_by_idx(
       loc_id, ".", H5_INDEX_NAME, H5_ITER_NATIVE, idx, NULL, 0, H5P_DEFAULT);
   CHECK_GE(str_size, 0) << "Error retrieving HDF5 dataset at index " << idx;
@@ -0,0 +1,156 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#ifdef USE_MKL
+  #include "mkl.h"
+#endif
+
+#include "caffe/common.hpp"
+#include "caffe/util/host_memory_pool.hpp"
+
+namespace caffe {
+
+// Each block starts with a kAlignment-sized header that records its size
+// class, so that Free needs nothing but the pointer.
+struct HostMemoryPoolState {
+  HostMemoryPoolState() : cache_limit(size_t(1) << 30) {
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.in_use = 0;
+    stats.peak_in_use = 0;
+    stats.cached = 0;
+  }
+  boost::mutex mutex;
+  std::map<size_t, std::vector<void*> > free_blocks;
+  size_t cache_limit;
+  HostMemoryPool::Stats stats;
+};
+
+// Never destroyed, since SyncedMemory may be freed during static destruction.
+static HostMemoryPoolState& pool_state() {
+  static HostMemoryPoolState* state = new HostMemoryPoolState();
+  return *state;
+}
+
+static void* SystemAllocate(size_t size) {
+  void* ptr = NULL;
+#ifdef USE_MKL
+  ptr = mkl_malloc(size, HostMemoryPool::kAlignment);
+#else
+  if (posix_memalign(&ptr, HostMemoryPool::kAlignment, size) != 0) {
+    ptr = NULL;
+  }
+#endif
+  CHECK(ptr) << "host allocation of size " << size << " failed";
+  return ptr;
+}
+
+static void SystemFree(void* ptr) {
+#ifdef USE_MKL
+  mkl_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+size_t HostMemoryPool::SizeClass(size_t size) {
+  size_t power = kAlignment;
+  if (size <= power) {
+    return power;
+  }
+  while (power * 2 < size) {
+    power *= 2;
+  }
+  const size_t step = power / 4;
+  return (size + step - 1) / step * step;
+}
+
+void* HostMemoryPool::Allocate(size_t size) {
+  const size_t block_size = SizeClass(size);
+  HostMemoryPoolState& state = pool_state();
+  char* block = NULL;
+  {
+    boost::mutex::scoped_lock lock(state.mutex);
+    std::vector<void*>& blocks = state.free_blocks[block_size];
+    if (blocks.empty()) {
+      ++state.stats.misses;
+    } else {
+      block = static_cast<char*>(blocks.back());
+      blocks.pop_back();
+      state.stats.cached -= block_size;
+      ++state.stats.hits;
+    }
+    state.stats.in_use += block_size;
+    state.stats.peak_in_use =
+        std::max(state.stats.peak_in_use, state.stats.in_use);
+  }
+  if (!block) {
+    block = static_cast<char*>(SystemAllocate(kAlignment + block_size));
+    *reinterpret_cast<size_t*>(block) = block_size;
+  }
+  return block + kAlignment;
+}
+
+void HostMemoryPool::Free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  char* block = static_cast<char*>(ptr) - kAlignment;
+  const size_t block_size = *reinterpret_cast<size_t*>(block);
+  HostMemoryPoolState& state = pool_state();
+  {
+    boost::mutex::scoped_lock lock(state.mutex);
+    state.stats.in_use -= block_size;
+    if (state.stats.cached + block_size <= state.cache_limit) {
+      state.free_blocks[block_size].push_back(block);
+      state.stats.cached += block_size;
+      return;
+    }
+  }
+  SystemFree(block);
+}
+
+void HostMemoryPool::ReleaseCached() {
+  HostMemoryPoolState& state = pool_state();
+  std::map<size_t, std::vector<void*> > free_blocks;
+  {
+    boost::mutex::scoped_lock lock(state.mutex);
+    free_blocks.swap(state.free_blocks);
+    state.stats.cached = 0;
+  }
+  for (std::map<size_t, std::vector<void*> >::iterator it =
+       free_blocks.begin(); it != free_blocks.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      SystemFree(it->second[i]);
+    }
+  }
+}
+
+size_t HostMemoryPool::cache_limit() {
+  HostMemoryPoolState& state = pool_state();
+  boost::mutex::scoped_lock lock(state.mutex);
+  return state.cache_limit;
+}
+
+void HostMemoryPool::set_cache_limit(size_t bytes) {
+  HostMemoryPoolState& state = pool_state();
+  {
+    boost::mutex::scoped_lock lock(state.mutex);
+    state.cache_limit = bytes;
+    if (state.stats.cached <= bytes) {
+      return;
+    }
+  }
+  ReleaseCached();
+}
+
+HostMemoryPool::Stats HostMemoryPool::stats() {
+  HostMemoryPoolState& state = pool_state();
+  boost::mutex::scoped_lock lock(state.mutex);
+  return state.stats;
+}
+
+}  // namespace caffe
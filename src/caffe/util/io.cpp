@@ -142,18 +142,23 @@ bool ReadImageToDatum(const string& filename, const int label,
 }
 #endif  // USE_OPENCV
 
+bool ReadFileToString(const string& filename, string* contents) {
+  fstream file(filename.c_str(), ios::in|ios::binary|ios::ate);
+  if (!file.is_open()) {
+    return false;
+  }
+  const std::streampos size = file.tellg();
+  contents->resize(size);
+  file.seekg(0, ios::beg);
+  if (size > 0) {
+    file.read(&(*contents)[0], size);
+  }
+  return !file.fail();
+}
+
 bool ReadFileToDatum(const string& filename, const int label,
     Datum* datum) {
-  std::streampos size;
-
-  fstream file(filename.c_str(), ios::in|ios::binary|ios::ate);
-  if (file.is_open()) {
-    size = file.tellg();
-    std::string buffer(size, ' ');
-    file.seekg(0, ios::beg);
-    file.read(&buffer[0], size);
-    file.close();
-    datum->set_data(buffer);
+  if (ReadFileToString(filename, datum->mutable_data())) {
     datum->set_label(label);
     datum->set_encoded(true);
     return true;
@@ -163,12 +168,86 @@ bool ReadFileToDatum(const string& filename, const int label,
 }
 
 #ifdef USE_OPENCV
+// Reads the size of a JPEG from its frame header, returning false if buffer
+// does not hold a JPEG.
+static bool ReadJPEGSize(const string& buffer, int* height, int* width) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer.data());
+  const size_t size = buffer.size();
+  if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+    return false;
+  }
+  // Segments up to the frame header each have a marker and a length.
+  size_t i = 2;
+  while (i + 4 <= size) {
+    if (data[i] != 0xFF) {
+      return false;
+    }
+    const uint8_t marker = data[i + 1];
+    if (marker == 0xFF) {
+      // Fill byte.
+      ++i;
+      continue;
+    }
+    // Start of frame markers, which DHT, JPG and DAC are not.
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (i + 9 > size) {
+        return false;
+      }
+      *height = (data[i + 5] << 8) | data[i + 6];
+      *width = (data[i + 7] << 8) | data[i + 8];
+      return true;
+    }
+    i += 2 + ((data[i + 2] << 8) | data[i + 3]);
+  }
+  return false;
+}
+
+cv::Mat DecodeImageToCVMat(const string& buffer, const int height,
+    const int width, const bool is_color, const bool reduced) {
+  int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
+    CV_LOAD_IMAGE_GRAYSCALE);
+  // Reduced decoding came with OpenCV 3.1; 2.4 defines CV_VERSION_EPOCH.
+#if !defined(CV_VERSION_EPOCH) && (CV_MAJOR_VERSION > 3 || \
+    (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 1))
+  int image_height, image_width;
+  if (reduced && height > 0 && width > 0 &&
+      ReadJPEGSize(buffer, &image_height, &image_width)) {
+    const int reduced_flags[] = {
+      is_color ? cv::IMREAD_REDUCED_COLOR_8 : cv::IMREAD_REDUCED_GRAYSCALE_8,
+      is_color ? cv::IMREAD_REDUCED_COLOR_4 : cv::IMREAD_REDUCED_GRAYSCALE_4,
+      is_color ? cv::IMREAD_REDUCED_COLOR_2 : cv::IMREAD_REDUCED_GRAYSCALE_2};
+    for (int i = 0, factor = 8; i < 3; ++i, factor /= 2) {
+      if (image_height / factor >= height && image_width / factor >= width) {
+        cv_read_flag = reduced_flags[i];
+        break;
+      }
+    }
+  }
+#endif
+  const cv::Mat encoded(1, buffer.size(), CV_8UC1,
+      const_cast<char*>(buffer.data()));
+  cv::Mat cv_img_origin = cv::imdecode(encoded, cv_read_flag);
+  if (!cv_img_origin.data) {
+    return cv_img_origin;
+  }
+  cv::Mat cv_img;
+  if (height > 0 && width > 0) {
+    cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
+  } else {
+    cv_img = cv_img_origin;
+  }
+  return cv_img;
+}
+
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  cv_img = cv::imdecode(vec_data, -1);
+  // Decode from the datum's own bytes, without copying them.
+  const cv::Mat encoded(1, data.size(), CV_8UC1,
+      const_cast<char*>(data.data()));
+  cv_img = cv::imdecode(encoded, -1);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
@@ -178,10 +257,11 @@ cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
+  const cv::Mat encoded(1, data.size(), CV_8UC1,
+      const_cast<char*>(data.data()));
   int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
     CV_LOAD_IMAGE_GRAYSCALE);
-  cv_img = cv::imdecode(vec_data, cv_read_flag);
+  cv_img = cv::imdecode(encoded, cv_read_flag);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
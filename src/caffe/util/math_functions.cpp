@@ -1,6 +1,7 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -64,6 +65,7 @@ void caffe_set(const int N, const Dtype alpha, Dtype* Y) {
   }
 }
 
+template void caffe_set<int8_t>(const int N, const int8_t alpha, int8_t* Y);
 template void caffe_set<int>(const int N, const int alpha, int* Y);
 template void caffe_set<float>(const int N, const float alpha, float* Y);
 template void caffe_set<double>(const int N, const double alpha, double* Y);
@@ -382,4 +384,135 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x) {
+  Dtype amax = 0;
+  for (int i = 0; i < n; ++i) {
+    amax = std::max(amax, std::fabs(x[i]));
+  }
+  return amax;
+}
+
+template
+float caffe_cpu_amax<float>(const int n, const float* x);
+
+template
+double caffe_cpu_amax<double>(const int n, const double* x);
+
+template <typename Dtype>
+void caffe_cpu_quantize_int8(const int n, const Dtype scale, const Dtype* x,
+    int8_t* y) {
+  const Dtype inv_scale = Dtype(1) / scale;
+  CAFFE_PARALLEL_FOR_IF(n >= CAFFE_PARALLEL_MIN_COUNT)
+  for (int i = 0; i < n; ++i) {
+    const Dtype q = std::max(Dtype(-127), std::min(x[i] * inv_scale,
+        Dtype(127)));
+    y[i] = static_cast<int8_t>(std::floor(q + Dtype(0.5)));
+  }
+}
+
+template
+void caffe_cpu_quantize_int8<float>(const int n, const float scale,
+    const float* x, int8_t* y);
+
+template
+void caffe_cpu_quantize_int8<double>(const int n, const double scale,
+    const double* x, int8_t* y);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows_int8(const int rows, const int cols,
+    const Dtype* x, int8_t* y, Dtype* scales) {
+  for (int i = 0; i < rows; ++i) {
+    const Dtype amax = caffe_cpu_amax(cols, x + i * cols);
+    scales[i] = amax > 0 ? amax / 127 : Dtype(1);
+    caffe_cpu_quantize_int8(cols, scales[i], x + i * cols, y + i * cols);
+  }
+}
+
+template
+void caffe_cpu_quantize_rows_int8<float>(const int rows, const int cols,
+    const float* x, int8_t* y, float* scales);
+
+template
+void caffe_cpu_quantize_rows_int8<double>(const int rows, const int cols,
+    const double* x, int8_t* y, double* scales);
+
+void caffe_cpu_gemm_int8(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const int8_t* A, const int8_t* B, int32_t* C) {
+  const int64_t work = static_cast<int64_t>(M) * N * K;
+  if (TransB == CblasNoTrans) {
+    // Accumulate a block of columns of each row of C from the rows of B, so
+    // that the innermost loop runs over contiguous memory and vectorizes,
+    // and the K x kBlockN block of B stays in cache across the rows of A.
+    // Consecutive tasks share a block, and so do those of one thread.
+    const int kBlockN = 256;
+    const int num_blocks = (N + kBlockN - 1) / kBlockN;
+    CAFFE_PARALLEL_FOR_IF(M * num_blocks > 1 &&
+        work >= CAFFE_PARALLEL_MIN_COUNT)
+    for (int task = 0; task < M * num_blocks; ++task) {
+      const int i = task % M;
+      const int j_begin = (task / M) * kBlockN;
+      const int j_end = std::min(N, j_begin + kBlockN);
+      int32_t* C_row = C + static_cast<int64_t>(i) * N;
+      for (int j = j_begin; j < j_end; ++j) {
+        C_row[j] = 0;
+      }
+      for (int k = 0; k < K; ++k) {
+        const int32_t a = A[static_cast<int64_t>(i) * K + k];
+        if (a == 0) {
+          continue;
+        }
+        const int8_t* B_row = B + static_cast<int64_t>(k) * N;
+        for (int j = j_begin; j < j_end; ++j) {
+          C_row[j] += a * B_row[j];
+        }
+      }
+    }
+  } else {
+    // Both operands are read along K: dot products of a row of A with a
+    // block of kBlockN rows of B, which stays in cache across the rows of A.
+    // Four rows of B are taken at a time to reuse each load from A. Tasks
+    // are split by block too, so that a single row (M == 1) still goes
+    // parallel.
+    const int kBlockN = 64;
+    const int num_blocks = (N + kBlockN - 1) / kBlockN;
+    CAFFE_PARALLEL_FOR_IF(M * num_blocks > 1 &&
+        work >= CAFFE_PARALLEL_MIN_COUNT)
+    for (int task = 0; task < M * num_blocks; ++task) {
+      const int i = task % M;
+      const int j_begin = (task / M) * kBlockN;
+      const int j_end = std::min(N, j_begin + kBlockN);
+      const int8_t* A_row = A + static_cast<int64_t>(i) * K;
+      int32_t* C_row = C + static_cast<int64_t>(i) * N;
+      int j = j_begin;
+      for (; j + 4 <= j_end; j += 4) {
+        const int8_t* B0 = B + static_cast<int64_t>(j) * K;
+        const int8_t* B1 = B0 + K;
+        const int8_t* B2 = B1 + K;
+        const int8_t* B3 = B2 + K;
+        int32_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+        for (int k = 0; k < K; ++k) {
+          const int32_t a = A_row[k];
+          sum0 += a * B0[k];
+          sum1 += a * B1[k];
+          sum2 += a * B2[k];
+          sum3 += a * B3[k];
+        }
+        C_row[j] = sum0;
+        C_row[j + 1] = sum1;
+        C_row[j + 2] = sum2;
+        C_row[j + 3] = sum3;
+      }
+      for (; j < j_end; ++j) {
+        const int8_t* B_row = B + static_cast<int64_t>(j) * K;
+        int32_t sum = 0;
+        for (int k = 0; k < K; ++k) {
+          sum += static_cast<int32_t>(A_row[k]) * B_row[k];
+        }
+        C_row[j] = sum;
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/plan_in_place.hpp"
+
+namespace caffe {
+
+// Whether a layer of the given type computes the right Forward, and in the
+// TRAIN phase also the right Backward, when its top is its bottom.
+static bool CanRunInPlace(const string& type, const bool train) {
+  static const char* kTrainTypes[] = { "BatchNorm", "Bias", "Dropout",
+      "PReLU", "ReLU", "Scale", "Sigmoid", "TanH" };
+  static const char* kTestTypes[] = { "AbsVal", "BNLL", "Clip", "ELU", "Exp",
+      "Log", "Power", "Swish", "Threshold" };
+  for (int i = 0; i < sizeof(kTrainTypes) / sizeof(kTrainTypes[0]); ++i) {
+    if (type == kTrainTypes[i]) {
+      return true;
+    }
+  }
+  for (int i = 0; i < sizeof(kTestTypes) / sizeof(kTestTypes[0]); ++i) {
+    if (type == kTestTypes[i]) {
+      return !train;
+    }
+  }
+  return false;
+}
+
+// Whether the Backward of a layer does not read its top data, which a
+// following layer rewritten to run in-place would overwrite.
+static bool BackwardIgnoresTop(const LayerParameter& layer_param) {
+  static const char* kTypes[] = { "BatchNorm", "Bias", "Concat",
+      "Convolution", "Data", "Deconvolution", "Dropout", "DummyData",
+      "HDF5Data", "ImageData", "InnerProduct", "MemoryData", "Pooling",
+      "PReLU", "Scale", "Slice", "WindowData" };
+  const string& type = layer_param.type();
+  if (type == "ReLU") {
+    // Its Backward reads its bottom data, which it only shares in-place.
+    return std::find(layer_param.bottom().begin(), layer_param.bottom().end(),
+        layer_param.top(0)) == layer_param.bottom().end();
+  }
+  for (int i = 0; i < sizeof(kTypes) / sizeof(kTypes[0]); ++i) {
+    if (type == kTypes[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Rename the blob from to the blob to in the bottoms and tops of a layer.
+static void RenameBlob(const string& from, const string& to,
+    LayerParameter* layer_param) {
+  for (int j = 0; j < layer_param->bottom_size(); ++j) {
+    if (layer_param->bottom(j) == from) {
+      layer_param->set_bottom(j, to);
+    }
+  }
+  for (int j = 0; j < layer_param->top_size(); ++j) {
+    if (layer_param->top(j) == from) {
+      layer_param->set_top(j, to);
+    }
+  }
+}
+
+void PlanInPlace(const NetParameter& param, NetParameter* param_in_place) {
+  // Initialize by copying from the input NetParameter.
+  param_in_place->CopyFrom(param);
+  const bool train = param.state().phase() == TRAIN;
+  // Count the consumers of each top blob, as InsertSplits does.
+  map<string, pair<int, int> > blob_name_to_last_top_idx;
+  map<pair<int, int>, pair<int, int> > bottom_idx_to_source_top_idx;
+  map<pair<int, int>, int> top_idx_to_bottom_count;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      map<string, pair<int, int> >::const_iterator top_idx =
+          blob_name_to_last_top_idx.find(layer_param.bottom(j));
+      // Unknown bottom blobs are left for InsertSplits to report.
+      if (top_idx != blob_name_to_last_top_idx.end()) {
+        bottom_idx_to_source_top_idx[make_pair(i, j)] = top_idx->second;
+        ++top_idx_to_bottom_count[top_idx->second];
+      }
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      blob_name_to_last_top_idx[layer_param.top(j)] = make_pair(i, j);
+    }
+    const int last_loss =
+        std::min(layer_param.loss_weight_size(), layer_param.top_size());
+    for (int j = 0; j < last_loss; ++j) {
+      if (layer_param.loss_weight(j)) {
+        ++top_idx_to_bottom_count[make_pair(i, j)];
+      }
+    }
+  }
+  // The layers that wrote the current contents of each blob, so far: the
+  // layer that produced it followed by the layers that ran in-place on it.
+  map<string, vector<int> > blob_name_to_writers;
+  for (int i = 0; i < param_in_place->layer_size(); ++i) {
+    LayerParameter* layer_param = param_in_place->mutable_layer(i);
+    if (layer_param->bottom_size() == 1 && layer_param->top_size() == 1 &&
+        layer_param->bottom(0) != layer_param->top(0) &&
+        CanRunInPlace(layer_param->type(), train) &&
+        bottom_idx_to_source_top_idx.count(make_pair(i, 0)) &&
+        top_idx_to_bottom_count[
+            bottom_idx_to_source_top_idx[make_pair(i, 0)]] == 1 &&
+        !blob_name_to_writers.count(layer_param->top(0))) {
+      const string bottom_name = layer_param->bottom(0);
+      const string& top_name = layer_param->top(0);
+      vector<int>& writers = blob_name_to_writers[bottom_name];
+      const LayerParameter& producer = param_in_place->layer(writers.front());
+      const LayerParameter& last_writer =
+          param_in_place->layer(writers.back());
+      // Keep the inputs of the net intact, and leave blobs that share their
+      // data with the bottom of their producer alone.
+      if (producer.type() != "Input" && producer.type() != "Reshape" &&
+          producer.type() != "Flatten" &&
+          (!train || BackwardIgnoresTop(last_writer))) {
+        for (int k = 0; k < writers.size(); ++k) {
+          RenameBlob(bottom_name, top_name,
+              param_in_place->mutable_layer(writers[k]));
+        }
+        layer_param->set_bottom(0, top_name);
+        blob_name_to_writers[top_name].swap(writers);
+        blob_name_to_writers.erase(bottom_name);
+        LOG_IF(INFO, Caffe::root_solver())
+            << "Running " << layer_param->name() << " in-place on "
+            << top_name << " instead of " << bottom_name;
+      }
+    }
+    for (int j = 0; j < layer_param->top_size(); ++j) {
+      const string& blob_name = layer_param->top(j);
+      if (std::find(layer_param->bottom().begin(), layer_param->bottom().end(),
+          blob_name) == layer_param->bottom().end()) {
+        blob_name_to_writers[blob_name].clear();
+      }
+      blob_name_to_writers[blob_name].push_back(i);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -5,6 +5,9 @@ namespace bp = boost::python;
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <cstring>
 #include <map>
@@ -46,6 +49,19 @@ DEFINE_string(snapshot, "",
 DEFINE_string(weights, "",
     "Optional; the pretrained weights to initialize finetuning, "
     "separated by ','. Cannot be set simultaneously with snapshot.");
+DEFINE_int32(threads, 0,
+    "Optional; number of CPU threads for intra-op layer parallelism "
+    "(0 = OpenMP default).");
+DEFINE_int32(processes, 1,
+    "Optional; number of CPU solver processes to train with, exchanging "
+    "gradients through shared memory. The effective training batch size is "
+    "multiplied by the number of processes.");
+DEFINE_string(hosts, "",
+    "Optional; the host:port endpoints, separated by ',', of the CPU solver "
+    "processes to train with over TCP, one per rank. The effective training "
+    "batch size is multiplied by their number.");
+DEFINE_int32(rank, 0,
+    "Optional; the rank of this process among those given by -hosts.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
 DEFINE_string(sigint_effect, "stop",
@@ -215,6 +231,29 @@ int train() {
     Caffe::set_solver_count(gpus.size());
   }
 
+  vector<string> hosts;
+  if (FLAGS_hosts.size()) {
+    CHECK_EQ(gpus.size(), 0) << "-hosts is for CPU training.";
+    CHECK_EQ(FLAGS_processes, 1) << "Give either -hosts or -processes.";
+    boost::split(hosts, FLAGS_hosts, boost::is_any_of(","));
+    CHECK_GE(FLAGS_rank, 0);
+    CHECK_LT(FLAGS_rank, hosts.size()) << "-rank is out of the -hosts.";
+    Caffe::set_solver_count(hosts.size());
+    Caffe::set_solver_rank(FLAGS_rank);
+    Caffe::set_multiprocess(true);
+  }
+
+  // Fork the CPU solver processes before anything starts threads.
+  string shm_name;
+  vector<pid_t> children;
+  if (FLAGS_processes > 1) {
+    CHECK_EQ(gpus.size(), 0) << "Multiple processes are for CPU training.";
+    shm_name = caffe::ShmAllreduce<float>::new_name();
+    Caffe::set_solver_count(FLAGS_processes);
+    Caffe::set_multiprocess(true);
+    children = caffe::ShmAllreduce<float>::fork_solvers();
+  }
+
   caffe::SignalHandler signal_handler(
         GetRequestedAction(FLAGS_sigint_effect),
         GetRequestedAction(FLAGS_sighup_effect));
@@ -229,7 +268,10 @@ int train() {
   shared_ptr<caffe::Solver<float> >
       solver(caffe::SolverRegistry<float>::CreateSolver(solver_param));
 
-  solver->SetActionFunction(signal_handler.GetActionFunction());
+  // Only rank 0 acts on signals, and stops the other processes with it.
+  if (Caffe::root_solver()) {
+    solver->SetActionFunction(signal_handler.GetActionFunction());
+  }
 
   if (FLAGS_snapshot.size()) {
     LOG(INFO) << "Resuming from " << FLAGS_snapshot;
@@ -244,10 +286,24 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (hosts.size() > 0) {
+    caffe::TcpAllreduce<float> tcp(solver, hosts);
+    tcp.Run();
+  } else if (FLAGS_processes > 1) {
+    caffe::ShmAllreduce<float> shm(solver, shm_name);
+    shm.Run();
+    // The other processes would wait forever on a rank 0 that stopped early.
+    const bool stopped_early = solver->iter() < solver_param.max_iter();
+    for (int i = 0; i < children.size(); ++i) {
+      if (stopped_early) {
+        kill(children[i], SIGTERM);
+      }
+      waitpid(children[i], NULL, 0);
+    }
   } else {
     solver->Solve();
   }
-  LOG(INFO) << "Optimization Done.";
+  LOG_IF(INFO, Caffe::root_solver()) << "Optimization Done.";
   return 0;
 }
 RegisterBrewFunction(train);
@@ -412,6 +468,9 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  const caffe::HostMemoryPool::Stats pool = caffe::HostMemoryPool::stats();
+  LOG(INFO) << "Host memory pool: " << pool.hits << " hits, " << pool.misses
+    << " misses, peak " << pool.peak_in_use << " bytes in use.";
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
@@ -432,6 +491,7 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  Caffe::set_num_threads(FLAGS_threads);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
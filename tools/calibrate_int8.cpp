@@ -0,0 +1,138 @@
+// This is a script to prepare a trained net for int8 inference (see
+// QuantizationParameter). It runs the net for a number of iterations on its
+// data layers to find the range of the bottom blob of each InnerProduct and
+// Convolution layer, then writes the net with those ranges and its weights
+// with theirs stored as int8, quantized per output channel.
+// Usage:
+//    calibrate_int8 net_proto_file_in weights_file_in iterations
+//        net_proto_file_out weights_file_out
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+// Whether a layer has an int8 CPU Forward.
+static bool IsQuantizable(const LayerParameter& layer_param) {
+  if (layer_param.type() == "InnerProduct") {
+    return true;
+  }
+  const ConvolutionParameter_Engine engine =
+      layer_param.convolution_param().engine();
+  return layer_param.type() == "Convolution" &&
+      (engine == ConvolutionParameter_Engine_DEFAULT ||
+       engine == ConvolutionParameter_Engine_CAFFE);
+}
+
+// Records the largest magnitude of the bottom of each quantizable layer, as
+// the layer is about to run.
+class BottomRangeRecorder : public Net<float>::Callback {
+ public:
+  explicit BottomRangeRecorder(const Net<float>& net)
+      : net_(net), bottom_max_(net.layers().size(), 0) {}
+  float bottom_max(int layer_id) const { return bottom_max_[layer_id]; }
+
+ protected:
+  virtual void run(int layer_id) {
+    if (!IsQuantizable(net_.layers()[layer_id]->layer_param())) {
+      return;
+    }
+    const Blob<float>* bottom = net_.bottom_vecs()[layer_id][0];
+    bottom_max_[layer_id] = std::max(bottom_max_[layer_id],
+        caffe_cpu_amax(bottom->count(), bottom->cpu_data()));
+  }
+
+ private:
+  const Net<float>& net_;
+  vector<float> bottom_max_;
+};
+
+// Stores the weights of a layer as int8, with a scale per output channel.
+static void QuantizeWeights(LayerParameter* layer_param) {
+  BlobProto* weights = layer_param->mutable_blobs(0);
+  Blob<float> blob;
+  blob.FromProto(*weights);
+  const int num_output = blob.shape(0);
+  string int8_data(blob.count(), 0);
+  vector<float> scales(num_output);
+  caffe_cpu_quantize_rows_int8(num_output, blob.count(1), blob.cpu_data(),
+      reinterpret_cast<int8_t*>(&int8_data[0]), &scales[0]);
+  weights->clear_data();
+  weights->clear_double_data();
+  weights->set_int8_data(int8_data);
+  for (int c = 0; c < num_output; ++c) {
+    weights->add_int8_scale(scales[c]);
+  }
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 6) {
+    LOG(ERROR) << "Usage: calibrate_int8 net_proto_file_in weights_file_in "
+               << "iterations net_proto_file_out weights_file_out";
+    return 1;
+  }
+  const int iterations = atoi(argv[3]);
+  CHECK_GT(iterations, 0) << "Calibrate on at least one iteration.";
+
+  NetParameter input_param;
+  ReadNetParamsFromTextFileOrDie(string(argv[1]), &input_param);
+  NetParameter net_param(input_param);
+  net_param.mutable_state()->set_phase(TEST);
+  Net<float> net(net_param);
+  net.CopyTrainedLayersFrom(string(argv[2]));
+  BottomRangeRecorder recorder(net);
+  net.add_before_forward(&recorder);
+  for (int i = 0; i < iterations; ++i) {
+    net.Forward();
+  }
+
+  // The weights come from the net, whose Split layers have none and are
+  // ignored when they are loaded.
+  NetParameter calibrated_param;
+  net.ToProto(&calibrated_param);
+  std::map<string, float> bottom_max;
+  for (int i = 0; i < calibrated_param.layer_size(); ++i) {
+    LayerParameter* layer_param = calibrated_param.mutable_layer(i);
+    if (!IsQuantizable(*layer_param)) {
+      continue;
+    }
+    layer_param->mutable_quantization_param()->set_bottom_max(
+        recorder.bottom_max(i));
+    bottom_max[layer_param->name()] = recorder.bottom_max(i);
+    // Transposed inner product weights are not laid out by output, and are
+    // kept as floats.
+    if (layer_param->type() == "Convolution" ||
+        !layer_param->inner_product_param().transpose()) {
+      QuantizeWeights(layer_param);
+    }
+    LOG(INFO) << "Quantizing " << layer_param->name() << " with bottom range "
+              << recorder.bottom_max(i);
+  }
+  WriteProtoToBinaryFile(calibrated_param, argv[5]);
+  // The definition is the input one, with only the ranges added, so that it
+  // keeps its other phases and gains none of the layers inserted by Net.
+  for (int i = 0; i < input_param.layer_size(); ++i) {
+    LayerParameter* layer_param = input_param.mutable_layer(i);
+    std::map<string, float>::const_iterator it =
+        bottom_max.find(layer_param->name());
+    if (it != bottom_max.end() && IsQuantizable(*layer_param)) {
+      layer_param->mutable_quantization_param()->set_bottom_max(it->second);
+    }
+  }
+  WriteProtoToTextFile(input_param, argv[4]);
+
+  LOG(INFO) << "Wrote calibrated net to " << argv[4] << " and its weights to "
+            << argv[5];
+  return 0;
+}
@@ -1,24 +1,197 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include "boost/thread.hpp"
 #include "google/protobuf/text_format.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 
 using caffe::Blob;
+using caffe::BlockingQueue;
 using caffe::Caffe;
+using caffe::CPUTimer;
 using caffe::Datum;
 using caffe::Net;
 using std::string;
 namespace db = caffe::db;
 
+// Batches in flight between the forward, serialization and write stages,
+// which bounds the memory of a slow stage's queue.
+const int kNumBatches = 4;
+// Rows between the commits of a db, and between progress reports.
+const int kCommitRows = 1000;
+
+// The features of a mini-batch, for each feature blob.
+template <typename Dtype>
+struct FeatureBatch {
+  // Index of the first row, and number of rows.
+  int start;
+  int num;
+  std::vector<std::vector<int> > shapes;
+  std::vector<std::vector<Dtype> > data;
+  // The rows serialized as Datums, for db outputs.
+  std::vector<std::vector<string> > values;
+};
+
+// Where the features of a blob go: a db of Datums, or with db type "raw" a
+// file of float32 rows that can be memory mapped, its shape being written to
+// a ".shape" file next to it.
+struct FeatureOutput {
+  string name;
+  boost::shared_ptr<db::DB> db;
+  boost::shared_ptr<db::Transaction> txn;
+  FILE* raw;
+  int rows;
+  std::vector<int> shape;
+};
+
+// Serializes the features of batches and writes them to their outputs, each
+// on a thread of its own, while the net runs forward on the main thread.
+// Batches go through the stages in order, in kNumBatches slots of batches_.
+template <typename Dtype>
+class FeaturePipeline {
+ public:
+  FeaturePipeline(int num_features, std::vector<FeatureOutput>* outputs)
+      : batches_(kNumBatches), outputs_(outputs), serialize_seconds_(0),
+        write_seconds_(0),
+        start_(boost::posix_time::microsec_clock::local_time()) {
+    for (int b = 0; b < kNumBatches; ++b) {
+      batches_[b].shapes.resize(num_features);
+      batches_[b].data.resize(num_features);
+      batches_[b].values.resize(num_features);
+      free_.push(b);
+    }
+    serializer_.reset(new boost::thread(&FeaturePipeline::Serialize, this));
+    writer_.reset(new boost::thread(&FeaturePipeline::Write, this));
+  }
+
+  // Waits for a batch to fill, once it is written.
+  FeatureBatch<Dtype>* NextBatch(int* slot) {
+    *slot = free_.pop("Waiting for features to be written");
+    return &batches_[*slot];
+  }
+  void Push(int slot) { to_serialize_.push(slot); }
+  // Waits for the batches pushed to be written.
+  void Finish() {
+    to_serialize_.push(-1);
+    serializer_->join();
+    writer_->join();
+  }
+
+  double ElapsedSeconds() const {
+    return (boost::posix_time::microsec_clock::local_time() - start_)
+        .total_microseconds() / 1e6;
+  }
+  double serialize_seconds() const { return serialize_seconds_; }
+  double write_seconds() const { return write_seconds_; }
+
+ private:
+  // A slot of -1 ends the stages.
+  void Serialize() {
+    CPUTimer timer;
+    for (int b; (b = to_serialize_.pop()) >= 0;) {
+      timer.Start();
+      SerializeFeatures(&batches_[b]);
+      serialize_seconds_ += timer.Seconds();
+      to_write_.push(b);
+    }
+    to_write_.push(-1);
+  }
+
+  void Write() {
+    CPUTimer timer;
+    for (int b; (b = to_write_.pop()) >= 0;) {
+      timer.Start();
+      const FeatureBatch<Dtype>& batch = batches_[b];
+      for (int i = 0; i < outputs_->size(); ++i) {
+        WriteFeatures(batch, i, &(*outputs_)[i]);
+      }
+      write_seconds_ += timer.Seconds();
+      const int rows = batch.start + batch.num;
+      if (rows / kCommitRows != batch.start / kCommitRows) {
+        LOG(ERROR)<< "Extracted features of " << rows << " query images ("
+            << rows / ElapsedSeconds() << " images/s)";
+      }
+      free_.push(b);
+    }
+  }
+
+  // Serializes the rows of each feature going to a db, splitting them
+  // across threads with OpenMP.
+  void SerializeFeatures(FeatureBatch<Dtype>* batch) {
+    for (int i = 0; i < outputs_->size(); ++i) {
+      if (!(*outputs_)[i].db) {
+        continue;
+      }
+      const std::vector<int>& shape = batch->shapes[i];
+      const std::vector<Dtype>& data = batch->data[i];
+      const int dim = data.size() / batch->num;
+      std::vector<string>& values = batch->values[i];
+      values.resize(batch->num);
+      CAFFE_PARALLEL_FOR
+      for (int n = 0; n < batch->num; ++n) {
+        Datum datum;
+        datum.set_channels(shape.size() > 1 ? shape[1] : 1);
+        datum.set_height(shape.size() > 2 ? shape[2] : 1);
+        datum.set_width(shape.size() > 3 ? shape[3] : 1);
+        datum.mutable_float_data()->Resize(dim, 0);
+        std::copy(data.begin() + n * dim, data.begin() + (n + 1) * dim,
+            datum.mutable_float_data()->mutable_data());
+        CHECK(datum.SerializeToString(&values[n]));
+      }
+    }
+  }
+
+  // Writes the rows of feature i to its output.
+  void WriteFeatures(const FeatureBatch<Dtype>& batch, int i,
+      FeatureOutput* output) {
+    if (output->shape.empty()) {
+      output->shape = batch.shapes[i];
+    }
+    if (output->raw) {
+      const std::vector<float> rows(batch.data[i].begin(),
+          batch.data[i].end());
+      CHECK_EQ(fwrite(&rows[0], sizeof(float), rows.size(), output->raw),
+          rows.size()) << "Failed to write to " << output->name;
+      output->rows += batch.num;
+      return;
+    }
+    for (int n = 0; n < batch.num; ++n) {
+      output->txn->Put(caffe::format_int(batch.start + n, 10),
+          batch.values[i][n]);
+      if (++output->rows % kCommitRows == 0) {
+        output->txn->Commit();
+        output->txn.reset(output->db->NewTransaction());
+      }
+    }
+  }
+
+  std::vector<FeatureBatch<Dtype> > batches_;
+  std::vector<FeatureOutput>* outputs_;
+  BlockingQueue<int> free_;
+  BlockingQueue<int> to_serialize_;
+  BlockingQueue<int> to_write_;
+  boost::shared_ptr<boost::thread> serializer_;
+  boost::shared_ptr<boost::thread> writer_;
+  double serialize_seconds_;
+  double write_seconds_;
+  boost::posix_time::ptime start_;
+};
+
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
 
@@ -42,7 +215,9 @@ int feature_extraction_pipeline(int argc, char** argv) {
     "Note: you can extract multiple features in one pass by specifying"
     " multiple feature blob names and dataset names separated by ','."
     " The names cannot contain white space characters and the number of blobs"
-    " and datasets must be equal.";
+    " and datasets must be equal.\n"
+    "db_type is leveldb, lmdb, recordio, or raw for files of float32 rows"
+    " with their shape in a .shape file next to them.";
     return 1;
   }
   int arg_pos = num_required_args;
@@ -118,65 +293,89 @@ int feature_extraction_pipeline(int argc, char** argv) {
 
   int num_mini_batches = atoi(argv[++arg_pos]);
 
-  std::vector<boost::shared_ptr<db::DB> > feature_dbs;
-  std::vector<boost::shared_ptr<db::Transaction> > txns;
-  const char* db_type = argv[++arg_pos];
+  const string db_type = argv[++arg_pos];
+  std::vector<FeatureOutput> outputs(num_features);
   for (size_t i = 0; i < num_features; ++i) {
     LOG(INFO)<< "Opening dataset " << dataset_names[i];
-    boost::shared_ptr<db::DB> db(db::GetDB(db_type));
-    db->Open(dataset_names.at(i), db::NEW);
-    feature_dbs.push_back(db);
-    boost::shared_ptr<db::Transaction> txn(db->NewTransaction());
-    txns.push_back(txn);
+    FeatureOutput& output = outputs[i];
+    output.name = dataset_names[i];
+    output.rows = 0;
+    output.raw = NULL;
+    if (db_type == "raw") {
+      output.raw = fopen(output.name.c_str(), "wb");
+      CHECK(output.raw) << "Failed to open " << output.name;
+    } else {
+      output.db.reset(db::GetDB(db_type));
+      output.db->Open(output.name, db::NEW);
+      output.txn.reset(output.db->NewTransaction());
+    }
   }
 
   LOG(ERROR)<< "Extracting Features";
 
-  Datum datum;
-  std::vector<int> image_indices(num_features, 0);
+  // The features of a batch are serialized and written while the net runs
+  // forward for the next ones.
+  FeaturePipeline<Dtype> pipeline(num_features, &outputs);
+  CPUTimer timer;
+  double forward_seconds = 0;
+  double wait_seconds = 0;
+  int num_rows = 0;
   for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
+    timer.Start();
+    int slot;
+    FeatureBatch<Dtype>* batch = pipeline.NextBatch(&slot);
+    wait_seconds += timer.Seconds();
+    timer.Start();
     feature_extraction_net->Forward();
+    batch->start = num_rows;
     for (int i = 0; i < num_features; ++i) {
       const boost::shared_ptr<Blob<Dtype> > feature_blob =
         feature_extraction_net->blob_by_name(blob_names[i]);
-      int batch_size = feature_blob->num();
-      int dim_features = feature_blob->count() / batch_size;
-      const Dtype* feature_blob_data;
-      for (int n = 0; n < batch_size; ++n) {
-        datum.set_height(feature_blob->height());
-        datum.set_width(feature_blob->width());
-        datum.set_channels(feature_blob->channels());
-        datum.clear_data();
-        datum.clear_float_data();
-        feature_blob_data = feature_blob->cpu_data() +
-            feature_blob->offset(n);
-        for (int d = 0; d < dim_features; ++d) {
-          datum.add_float_data(feature_blob_data[d]);
-        }
-        string key_str = caffe::format_int(image_indices[i], 10);
-
-        string out;
-        CHECK(datum.SerializeToString(&out));
-        txns.at(i)->Put(key_str, out);
-        ++image_indices[i];
-        if (image_indices[i] % 1000 == 0) {
-          txns.at(i)->Commit();
-          txns.at(i).reset(feature_dbs.at(i)->NewTransaction());
-          LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-              " query images for feature blob " << blob_names[i];
-        }
-      }  // for (int n = 0; n < batch_size; ++n)
-    }  // for (int i = 0; i < num_features; ++i)
+      if (i == 0) {
+        batch->num = feature_blob->num();
+      }
+      CHECK_EQ(feature_blob->num(), batch->num)
+          << "Feature blobs must have the same batch size";
+      batch->shapes[i] = feature_blob->shape();
+      batch->data[i].assign(feature_blob->cpu_data(),
+          feature_blob->cpu_data() + feature_blob->count());
+    }
+    num_rows += batch->num;
+    forward_seconds += timer.Seconds();
+    pipeline.Push(slot);
   }  // for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index)
+  pipeline.Finish();
+  const double total_seconds = pipeline.ElapsedSeconds();
+
   // write the last batch
   for (int i = 0; i < num_features; ++i) {
-    if (image_indices[i] % 1000 != 0) {
-      txns.at(i)->Commit();
+    FeatureOutput& output = outputs[i];
+    if (output.raw) {
+      CHECK_EQ(fclose(output.raw), 0) << "Failed to write " << output.name;
+      std::ofstream shape_file((output.name + ".shape").c_str());
+      shape_file << output.rows;
+      for (int j = 1; j < output.shape.size(); ++j) {
+        shape_file << " " << output.shape[j];
+      }
+      shape_file << std::endl;
+      CHECK(shape_file.good()) << "Failed to write " << output.name
+          << ".shape";
+    } else {
+      if (output.rows % kCommitRows != 0) {
+        output.txn->Commit();
+      }
+      output.db->Close();
     }
-    LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
+    LOG(ERROR)<< "Extracted features of " << output.rows <<
         " query images for feature blob " << blob_names[i];
-    feature_dbs.at(i)->Close();
   }
+  LOG(ERROR)<< "Extracted " << num_rows << " images in " << total_seconds
+      << " s, " << num_rows / total_seconds << " images/s";
+  // The slowest stage is the one the others wait on.
+  LOG(ERROR)<< "Forward: " << forward_seconds << " s, waiting for writes: "
+      << wait_seconds << " s, serialization: "
+      << pipeline.serialize_seconds() << " s, writes: "
+      << pipeline.write_seconds() << " s";
 
   LOG(ERROR)<< "Successfully extracted the features!";
   return 0;
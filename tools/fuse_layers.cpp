@@ -0,0 +1,44 @@
+// This is a script to fold the BatchNorm and Scale layers of a trained net
+// into the convolutions that they follow, and to fuse its ReLUs into them,
+// for faster inference (see NetParameter.fuse_layers).
+// Usage:
+//    fuse_layers net_proto_file_in weights_file_in
+//        net_proto_file_out weights_file_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: fuse_layers net_proto_file_in weights_file_in "
+               << "net_proto_file_out weights_file_out";
+    return 1;
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(string(argv[1]), &net_param);
+  net_param.mutable_state()->set_phase(TEST);
+  net_param.set_fuse_layers(true);
+  Net<float> net(net_param);
+  net.CopyTrainedLayersFrom(string(argv[2]));
+
+  // The fused net needs no further fusion, and holds the folded weights.
+  NetParameter fused_param;
+  net.ToProto(&fused_param);
+  WriteProtoToBinaryFile(fused_param, argv[4]);
+  for (int i = 0; i < fused_param.layer_size(); ++i) {
+    fused_param.mutable_layer(i)->clear_blobs();
+  }
+  WriteProtoToTextFile(fused_param, argv[3]);
+
+  LOG(INFO) << "Wrote fused net of " << fused_param.layer_size()
+            << " layers to " << argv[3] << " and its weights to " << argv[4];
+  return 0;
+}